@@ -0,0 +1,69 @@
+#ifndef BENCH_UTIL_HPP
+#define BENCH_UTIL_HPP
+
+// timing of whole interpreter runs, shared by the benchmarks that start build/parser as a
+// process. every command goes through sh, so it can redirect; a run that fails stops the
+// benchmark
+
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+#include<sys/resource.h>
+#include<sys/wait.h>
+#include<unistd.h>
+
+// the interpreter is built next to the benchmark
+inline std::string interpreterPath(const char* argv0){
+    std::string self = argv0;
+    return self.substr(0, self.find_last_of('/') + 1) + "parser";
+}
+
+// average wall time of runs runs of command
+inline double msPerRun(const std::string& command, int runs){
+    auto start = std::chrono::steady_clock::now();
+    for(int k = 0; k < runs; k++){
+        if(system(command.c_str()) != 0){
+            fprintf(stderr, "failed: %s\n", command.c_str());
+            exit(1);
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / runs;
+}
+
+struct Run {
+    double ms;
+    long peakKb;    // peak resident memory, from wait4()
+};
+
+// one run of command, which is exec'd by sh so the peak memory is the interpreter's
+inline Run timeRun(const std::string& command){
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if(pid == 0){
+        execl("/bin/sh", "sh", "-c", ("exec " + command).c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        fprintf(stderr, "failed: %s\n", command.c_str());
+        exit(1);
+    }
+    return { elapsed.count(), usage.ru_maxrss };
+}
+
+// the fastest of runs runs, with the peak memory of the first
+inline Run bestRun(const std::string& command, int runs){
+    Run best = timeRun(command);
+    for(int k = 1; k < runs; k++){
+        Run r = timeRun(command);
+        if(r.ms < best.ms) best.ms = r.ms;
+    }
+    return best;
+}
+
+#endif
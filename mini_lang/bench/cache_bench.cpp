@@ -0,0 +1,55 @@
+// benchmark for the compiled-program cache (src/progcache.cpp).
+// starts the interpreter on a generated script that takes long to parse and optimize but
+// little to run: without a cache, with an empty cache (parse, optimize and store the entry)
+// and with the entry already stored. the times are for the whole process, startup and the
+// shell that starts it included.
+//
+//   make bench
+
+#include "bench_util.hpp"
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+
+namespace {
+
+// assignments of nested arithmetic, ifs and short counting loops over a fixed set of
+// variables, every statement different so the optimizer can not collapse them
+void writeScript(const std::string& path, int lines){
+    FILE* f = fopen(path.c_str(), "w");
+    for(int v = 0; v < 16; v++) fprintf(f, "var a%d = %d;\n", v, v);
+    for(int v = 0; v < 8; v++) fprintf(f, "var i%d = 0;\n", v);
+    fprintf(f, "var x = 7;\nvar y = 3;\n");
+    for(int k = 0; k < lines; k += 4){
+        int a = k % 16, i = k % 8;
+        fprintf(f, "a%d = (x + %d) * (y - %d) / 3 + x * %d;\n", a, k, k % 17, k % 13 + 2);
+        fprintf(f, "if (a%d > %d) { y = y + a%d / %d; } else { x = x - %d; }\n", a, k, a, k % 7 + 1, k % 5);
+        fprintf(f, "i%d = 0;\n", i);
+        fprintf(f, "while (i%d < %d) { x = x + i%d * %d; i%d = i%d + 1; }\n", i, k % 3 + 2, i, k % 11, i, i);
+    }
+    fclose(f);
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    std::string parser = interpreterPath(argv[0]);
+    std::string script = "/tmp/mini_lang_cache_bench.txt";
+    std::string cache = "/tmp/mini_lang_cache_bench";
+    const int runs = 3;
+
+    printf("startup, ms per run           no cache     cold      warm\n");
+    for(int lines : { 250, 1000, 2000 }){
+        writeScript(script, lines);
+        std::string run = parser + " < " + script + " > /dev/null";
+        std::string cached = parser + " --cache-dir=" + cache + " < " + script + " > /dev/null";
+
+        double plain = msPerRun(run, runs);
+        double cold = msPerRun("rm -rf " + cache + " && " + cached, runs);
+        double warm = msPerRun(cached, runs);
+        printf("  %6d lines              %9.2f %9.2f %9.2f\n", lines, plain, cold, warm);
+    }
+
+    system(("rm -rf " + cache + " " + script).c_str());
+    return 0;
+}
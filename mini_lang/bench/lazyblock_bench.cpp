@@ -0,0 +1,58 @@
+// benchmark for lazy block parsing (src/lazyblock.cpp).
+// runs the interpreter on a generated program where most of the code sits in if branches
+// that are never taken: every top-level if guards a block of a few dozen statements with a
+// condition that is false. parsed up front, all of it becomes nodes, gets listed and is
+// skipped at run time; with --lazy-blocks it is only brace-matched. both run without the
+// optimizer, which --lazy-blocks leaves out. whole runs are timed, and the peak resident
+// memory of each run is taken from wait4().
+//
+//   make bench
+
+#include "bench_util.hpp"
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+
+namespace {
+
+void writeScript(const std::string& path, int branches, int branchLines){
+    FILE* f = fopen(path.c_str(), "w");
+    for(int v = 0; v < 16; v++) fprintf(f, "var a%d = %d;\n", v, v);
+    for(int k = 0; k < branches; k++){
+        int a = k % 16, b = k * 7 % 16;
+        fprintf(f, "a%d = a%d + %d;\n", a, b, k % 10);
+        fprintf(f, "if (a%d < 0 - %d) {\n", a, 1000000 + k);
+        for(int j = 0; j < branchLines; j++){
+            int c = (k + j) % 16;
+            fprintf(f, "    a%d = (a%d + %d) * 3 - a%d / 7;\n", c, a, j, b);
+            if(j % 10 == 9) fprintf(f, "    if (a%d > %d) { a%d = a%d - 1; } else { a%d = 0; }\n", c, j, b, b, c);
+        }
+        fprintf(f, "}\n");
+    }
+    fclose(f);
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    std::string parser = interpreterPath(argv[0]);
+    std::string script = "/tmp/mini_lang_lazyblock_bench.txt";
+    const int branches = 2000;
+    const int branchLines = 40;
+    const int runs = 3;
+
+    writeScript(script, branches, branchLines);
+    const char* modes[][2] = {
+        { "parsed up front", " --no-opt" },
+        { "--lazy-blocks", " --lazy-blocks" },
+    };
+    printf("%d branches of %d lines, none taken, best of %d runs\n", branches, branchLines, runs);
+    printf("  mode                    ms    peak MB\n");
+    for(auto& mode : modes){
+        Run r = bestRun(parser + mode[1] + " < " + script + " > /dev/null", runs);
+        printf("  %-16s %9.1f %10.1f\n", mode[0], r.ms, r.peakKb / 1024.0);
+    }
+
+    remove(script.c_str());
+    return 0;
+}
@@ -0,0 +1,134 @@
+// benchmark for the hand-written scanner (src/simdlex.cpp) against the flex one.
+// both read the same generated source from memory and hand every token over the way the
+// parser gets it (yylval filled in, identifiers copied). the raw rows are scanToken()
+// alone, without the copies. before timing, the token streams are checked to be the same.
+//
+//   make bench
+
+#include "ast.hpp"
+#include "parser.tab.hpp"
+#include "simdlex.hpp"
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+
+YYSTYPE yylval;
+extern FILE* yyin;
+int yylex();
+void yyrestart(FILE* file);
+
+namespace {
+
+// indented code with long names, comments and blank lines, the kind of text the wide
+// skips are for
+std::string makeSource(size_t bytes){
+    std::string s;
+    char line[256];
+    for(int k = 0; s.size() < bytes; k++){
+        snprintf(line, sizeof(line), "// step %d: fold the running total into the accumulator\n\n", k);
+        s += line;
+        snprintf(line, sizeof(line), "var accumulatorValue%d = runningTotalCounter%d * %d + 12345;\n", k, k % 97, k % 1000);
+        s += line;
+        snprintf(line, sizeof(line), "if (accumulatorValue%d >= %d) {\n        runningTotalCounter%d = runningTotalCounter%d - 1;   // wrap\n    } else {\n        x = x + 1;\n    }\n", k, k * 7, k % 97, k % 97);
+        s += line;
+        snprintf(line, sizeof(line), "    while (loopIndexVariable != %d) { loopIndexVariable = loopIndexVariable + 1; }\n", k % 50);
+        s += line;
+    }
+    return s;
+}
+
+typedef int (*NextToken)();
+
+// token count and a checksum over kinds and values
+struct Stream {
+    long tokens = 0;
+    unsigned long long sum = 0;
+};
+
+Stream run(NextToken next){
+    Stream out;
+    for(int t; (t = next()) != 0;){
+        out.tokens++;
+        out.sum = out.sum * 31 + t;
+        if(t == INTEGER) out.sum += yylval.ival;
+        if(t == IDENTIFIER){
+            for(const char* c = yylval.sval; *c; c++) out.sum = out.sum * 7 + *c;
+            free(yylval.sval);
+        }
+    }
+    return out;
+}
+
+Stream runFlex(const std::string& source){
+    FILE* in = fmemopen((void*)source.data(), source.size(), "r");
+    yyrestart(in);
+    Stream out = run(yylex);
+    fclose(in);
+    return out;
+}
+
+Stream runSimd(const std::string& source){
+    setScannerSource(source);
+    return run(simdLex);
+}
+
+long runRaw(const std::string& padded, size_t size){
+    Scanner s = { padded.data(), padded.data() + size };
+    Token token;
+    long tokens = 0;
+    for(scanToken(s, token); token.kind != 0; scanToken(s, token)) tokens++;
+    return tokens;
+}
+
+template<typename F>
+double bestSeconds(F f, int runs){
+    double best = 1e9;
+    for(int k = 0; k < runs; k++){
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if(elapsed.count() < best) best = elapsed.count();
+    }
+    return best;
+}
+
+void report(const char* name, long tokens, size_t bytes, double seconds, double flexSeconds){
+    printf("  %-18s %10.1f %10.1f %9.2fx\n", name, tokens / seconds / 1e6, bytes / seconds / 1e6, flexSeconds / seconds);
+}
+
+} // namespace
+
+int main(){
+    const size_t bytes = 32 << 20;
+    const int runs = 3;
+    std::string source = makeSource(bytes);
+    std::string padded = source + std::string(scanPadding, '\0');
+
+    Stream flex = runFlex(source);
+    const char* sets[] = { "avx2", "sse2", "none" };
+    for(const char* set : sets){
+        if(!selectScannerInstructionSet(set)) continue;
+        Stream simd = runSimd(source);
+        if(simd.tokens != flex.tokens || simd.sum != flex.sum){
+            fprintf(stderr, "token streams differ (%s): %ld vs %ld tokens\n", set, simd.tokens, flex.tokens);
+            return 1;
+        }
+    }
+
+    printf("%zu bytes, %ld tokens\n", source.size(), flex.tokens);
+    printf("  scanner             Mtokens/s       MB/s   vs flex\n");
+    double flexSeconds = bestSeconds([&]{ runFlex(source); }, runs);
+    report("flex", flex.tokens, source.size(), flexSeconds, flexSeconds);
+    for(const char* set : sets){
+        if(!selectScannerInstructionSet(set)) continue;
+        std::string name = std::string("simdLex ") + set;
+        report(name.c_str(), flex.tokens, source.size(), bestSeconds([&]{ runSimd(source); }, runs), flexSeconds);
+    }
+    for(const char* set : sets){
+        if(!selectScannerInstructionSet(set)) continue;
+        std::string name = std::string("raw ") + set;
+        report(name.c_str(), flex.tokens, source.size(), bestSeconds([&]{ runRaw(padded, source.size()); }, runs), flexSeconds);
+    }
+    return 0;
+}
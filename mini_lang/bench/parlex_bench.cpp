@@ -0,0 +1,91 @@
+// benchmark for parallel lexing (src/parlex.cpp).
+// writes a large generated source, maps it like --lex-threads does and scans it with 1, 2,
+// 4, ... threads up to the number of cores (at least 4). "scan" is lexInParallel alone,
+// "to parser" adds handing every token over through chunkLex(), which runs on one thread.
+// the tokens of every thread count are checked against a single scanner first.
+//
+//   make bench
+
+#include "ast.hpp"
+#include "parser.tab.hpp"
+#include "parlex.hpp"
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+#include<thread>
+
+YYSTYPE yylval;
+
+namespace {
+
+void writeSource(const std::string& path, size_t bytes){
+    FILE* f = fopen(path.c_str(), "w");
+    size_t written = 0;
+    for(int k = 0; written < bytes; k++){
+        written += fprintf(f, "// step %d: fold the running total into the accumulator\n", k);
+        written += fprintf(f, "var accumulatorValue%d = runningTotalCounter%d * %d + 12345;\n", k, k % 97, k % 1000);
+        written += fprintf(f, "if (accumulatorValue%d >= %d) {\n    runningTotalCounter%d = runningTotalCounter%d - 1;\n} else {\n    x = x + 1;\n}\n", k, k * 7, k % 97, k % 97);
+    }
+    fclose(f);
+}
+
+double seconds(std::chrono::steady_clock::time_point start){
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+long tokenCount(){
+    long n = 0;
+    for(const std::vector<Token>& c : lexedChunks()) n += c.size();
+    return n;
+}
+
+} // namespace
+
+int main(){
+    const std::string path = "/tmp/mini_lang_parlex_bench.txt";
+    const int runs = 3;
+    writeSource(path, 128 << 20);
+    FILE* in = fopen(path.c_str(), "r");
+    if(!in || !mapInput(in)){
+        fprintf(stderr, "cannot map %s\n", path.c_str());
+        return 1;
+    }
+
+    // reference: one chunk through the plain scanner
+    Scanner s = { inputText(), inputText() + inputSize() };
+    Token token;
+    long tokens = 0;
+    for(scanToken(s, token); token.kind != 0; scanToken(s, token)) tokens++;
+
+    unsigned cores = std::thread::hardware_concurrency();
+    printf("%zu bytes, %ld tokens, %u cores\n", inputSize(), tokens, cores);
+    printf("  threads  chunks    scan ms   speedup   to parser ms\n");
+    double single = 0;
+    for(unsigned threads = 1; threads <= (cores > 4 ? cores : 4); threads *= 2){
+        double scan = 1e9, total = 1e9;
+        size_t chunkCount = 0;
+        for(int r = 0; r < runs; r++){
+            auto start = std::chrono::steady_clock::now();
+            lexInParallel(inputText(), inputSize(), threads);
+            double t = seconds(start);
+            if(t < scan) scan = t;
+            chunkCount = lexedChunks().size();
+            if(tokenCount() != tokens){
+                fprintf(stderr, "%u threads: %ld tokens, expected %ld\n", threads, tokenCount(), tokens);
+                return 1;
+            }
+            for(int kind; (kind = chunkLex()) != 0;){
+                if(kind == IDENTIFIER) free(yylval.sval);
+            }
+            t = seconds(start);
+            if(t < total) total = t;
+        }
+        if(threads == 1) single = scan;
+        printf("  %7u %7zu %10.1f %8.2fx %14.1f\n", threads, chunkCount, scan * 1000, single / scan, total * 1000);
+    }
+    fclose(in);
+    remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,92 @@
+// benchmark for the hand-written parser (src/pratt.cpp) against the bison parser.
+// the source is scanned once up front, then both parsers build the tree from the same
+// tokens several times; only the parse is timed, deleting the statements is not. the
+// expressions are deep on purpose: every literal costs bison a reduction per precedence
+// level, and the pratt loop none.
+//
+//   make bench
+
+#include "ast.hpp"
+#include "parser.tab.hpp"
+#include "parlex.hpp"
+#include "pratt.hpp"
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+#include<vector>
+
+namespace {
+
+std::string makeSource(int lines){
+    std::string s;
+    char line[256];
+    for(int v = 0; v < 16; v++){
+        snprintf(line, sizeof(line), "var a%d = %d;\n", v, v);
+        s += line;
+    }
+    for(int k = 0; k < lines; k++){
+        int a = k % 16, b = (k * 7) % 16, c = (k * 13) % 16;
+        switch(k % 4){
+            case 0:
+                snprintf(line, sizeof(line), "a%d = (a%d + %d) * a%d - a%d / 3;\n", a, b, k % 100, c, a);
+                break;
+            case 1:
+                snprintf(line, sizeof(line), "if (a%d < a%d + 4) a%d = a%d - 1; else { a%d = -a%d; }\n", a, b, c, c, a, b);
+                break;
+            case 2:
+                snprintf(line, sizeof(line), "while (a%d > %d) { a%d = a%d - 1; a%d = a%d * 2 + 1; }\n", a, k % 50, a, a, b, c);
+                break;
+            default:
+                snprintf(line, sizeof(line), "{ var t%d = a%d == a%d; a%d = t%d != 0; }\n", k % 500, a, b, c, k % 500);
+                break;
+        }
+        s += line;
+    }
+    return s;
+}
+
+double bestMs(int (*parse)(ParseContext&), const std::vector<Token>& tokens, int runs, size_t& statements){
+    double best = 1e9;
+    for(int k = 0; k < runs; k++){
+        std::vector<Stmt*> out;
+        ParseContext context;
+        context.statements = &out;
+        context.next = tokens.data();
+        context.end = tokens.data() + tokens.size();
+        auto start = std::chrono::steady_clock::now();
+        if(parse(context) != 0) exit(1);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if(elapsed.count() < best) best = elapsed.count();
+        statements = out.size();
+        for(Stmt* s : out) delete s;
+    }
+    return best;
+}
+
+} // namespace
+
+int main(){
+    const int runs = 3;
+    std::string source = makeSource(400000);
+    std::string padded = source + std::string(scanPadding, '\0');
+    lexInParallel(padded.data(), source.size(), 1);
+    std::vector<Token> tokens;
+    for(const std::vector<Token>& chunk : lexedChunks()){
+        tokens.insert(tokens.end(), chunk.begin(), chunk.end());
+    }
+
+    size_t bisonStatements = 0, prattStatements = 0;
+    double bison = bestMs(yyparse, tokens, runs, bisonStatements);
+    double pratt = bestMs(prattParse, tokens, runs, prattStatements);
+    if(bisonStatements != prattStatements){
+        fprintf(stderr, "pratt parsed %zu statements, bison %zu\n", prattStatements, bisonStatements);
+        return 1;
+    }
+
+    printf("%zu bytes of source, %zu tokens, %zu top-level statements\n", source.size(), tokens.size(), bisonStatements);
+    printf("  parser             ms   Mtokens/s\n");
+    printf("  bison        %8.1f %10.1f\n", bison, tokens.size() / bison / 1e3);
+    printf("  pratt        %8.1f %10.1f\n", pratt, tokens.size() / pratt / 1e3);
+    return 0;
+}
@@ -0,0 +1,172 @@
+// benchmark for incremental reparsing (src/reparse.cpp).
+// a generated 100k line program gets single-line edits at random lines: a digit changed, a
+// statement inserted, a statement deleted. each edit is timed against parsing the whole
+// text again. half of the program is short top-level statements, the other half large
+// top-level blocks of them, where an edit damages one big statement and most of its
+// blocks are kept. at the end the edited tree must hash like a fresh parse of the text.
+//
+//   make bench
+
+#include "ast.hpp"
+#include "parser.tab.hpp"
+#include "pratt.hpp"
+#include "reparse.hpp"
+#include<algorithm>
+#include<chrono>
+#include<cstdarg>
+#include<cstdio>
+#include<cstdlib>
+#include<random>
+#include<string>
+
+namespace {
+
+void addLine(std::string& s, const char* indent, const char* format, ...){
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    s += indent;
+    s += text;
+    s += '\n';
+}
+
+// twenty lines: a while with an if / else and a nested block in it, then an if / else
+void unit(std::string& s, int k, const char* indent){
+    int a = k % 16, b = k * 7 % 16;
+    addLine(s, indent, "var v%d = %d;", k, k % 10);
+    addLine(s, indent, "a%d = a%d + %d;", a, b, k % 100);
+    addLine(s, indent, "while (v%d < 10) {", k);
+    addLine(s, indent, "    v%d = v%d + 1;", k, k);
+    addLine(s, indent, "    if (a%d > %d) {", a, k % 50);
+    addLine(s, indent, "        a%d = a%d - 1;", a, a);
+    addLine(s, indent, "        a%d = a%d * 2 + 1;", b, b);
+    addLine(s, indent, "    } else {");
+    addLine(s, indent, "        a%d = a%d + 3;", a, a);
+    addLine(s, indent, "    }");
+    addLine(s, indent, "    {");
+    addLine(s, indent, "        var t%d = a%d + a%d;", k, a, b);
+    addLine(s, indent, "        a%d = t%d / 2;", b, k);
+    addLine(s, indent, "    }");
+    addLine(s, indent, "}");
+    addLine(s, indent, "if (a%d == a%d) {", a, b);
+    addLine(s, indent, "    a%d = 0;", a);
+    addLine(s, indent, "} else {");
+    addLine(s, indent, "    a%d = a%d - v%d;", b, b, k);
+    addLine(s, indent, "}");
+}
+
+std::string makeSource(int lines){
+    std::string s;
+    for(int v = 0; v < 16; v++) addLine(s, "", "var a%d = %d;", v, v);
+    int k = 0;
+    for(int done = 16; done < lines; ){
+        if(k % 100 < 50){
+            unit(s, k++, "");
+            done += 20;
+        }else{
+            s += "{\n";
+            for(int u = 0; u < 50; u++) unit(s, k++, "    ");
+            s += "}\n";
+            done += 1002;
+        }
+    }
+    return s;
+}
+
+struct Line {
+    size_t start;
+    size_t end;     // the '\n'
+};
+
+Line lineAt(const std::string& s, size_t offset){
+    size_t start = s.rfind('\n', offset == 0 ? 0 : offset - 1);
+    start = start == std::string::npos || offset == 0 ? 0 : start + 1;
+    return { start, s.find('\n', offset) };
+}
+
+struct Result {
+    double fullMs = 0;
+    double meanMs = 0;
+    double maxMs = 0;
+    double tokens = 0;
+    double statements = 0;
+    double blocks = 0;
+};
+
+double msSince(std::chrono::steady_clock::time_point start){
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+Result run(int (*parse)(ParseContext&), std::string text, int edits){
+    Result result;
+    IncrementalParser parser(parse);
+    auto start = std::chrono::steady_clock::now();
+    if(!parser.reset(text)) exit(1);
+    result.fullMs = msSince(start);
+
+    std::mt19937 random(1);
+    for(int e = 0; e < edits; e++){
+        Line line = lineAt(text, random() % text.size());
+        size_t offset = line.start, removed = 0;
+        std::string inserted;
+        switch(e % 3){
+            case 0: {       // a digit
+                size_t digit = text.find_first_of("0123456789", line.start);
+                if(digit == std::string::npos) digit = text.find_first_of("0123456789");
+                offset = digit;
+                removed = 1;
+                inserted = std::string(1, text[digit] == '9' ? '1' : text[digit] + 1);
+                break;
+            }
+            case 1:         // a new statement
+                inserted = "a3 = a3 + 1;\n";
+                break;
+            default:        // a statement gone, braces stay
+                while(std::count(text.begin() + line.start, text.begin() + line.end, '{') +
+                      std::count(text.begin() + line.start, text.begin() + line.end, '}') > 0){
+                    line = lineAt(text, random() % text.size());
+                }
+                offset = line.start;
+                removed = line.end + 1 - line.start;
+                break;
+        }
+        text.replace(offset, removed, inserted);
+        start = std::chrono::steady_clock::now();
+        if(!parser.edit(offset, removed, inserted)) exit(1);
+        double ms = msSince(start);
+        result.meanMs += ms / edits;
+        result.maxMs = std::max(result.maxMs, ms);
+        result.tokens += (double)parser.tokensScanned / edits;
+        result.statements += (double)parser.statementsParsed / edits;
+        result.blocks += (double)parser.blocksReused / edits;
+    }
+
+    IncrementalParser fresh(parse);
+    if(!fresh.reset(text) || programHash(fresh.statements()) != programHash(parser.statements())){
+        fprintf(stderr, "the edited tree differs from a fresh parse\n");
+        exit(1);
+    }
+    return result;
+}
+
+} // namespace
+
+int main(){
+    const int lines = 100000;
+    const int edits = 3000;
+    std::string source = makeSource(lines);
+
+    printf("%zu bytes of source, %d single-line edits\n", source.size(), edits);
+    printf("  parser   full parse ms   edit mean ms   edit max ms   tokens   statements   blocks kept\n");
+    const char* names[] = { "bison", "pratt" };
+    int (*parsers[])(ParseContext&) = { yyparse, prattParse };
+    for(int p = 0; p < 2; p++){
+        Result r = run(parsers[p], source, edits);
+        printf("  %-6s %15.1f %14.3f %13.3f %8.0f %12.1f %13.1f\n", names[p], r.fullMs, r.meanMs, r.maxMs,
+               r.tokens, r.statements, r.blocks);
+    }
+    return 0;
+}
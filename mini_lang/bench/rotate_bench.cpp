@@ -0,0 +1,82 @@
+// benchmark for loop rotation (src/opt_rotate.cpp).
+// tight counting loops run by the interpreter, once as while loops and once rotated into
+// a guarded do-while. the nested case enters its inner loop often, so it shows what the
+// guard costs per entry.
+//
+//   make bench
+
+#include "ast.hpp"
+#include "optimize.hpp"
+#include<chrono>
+#include<cstdio>
+#include<vector>
+
+void execStmt(Stmt* stmt);
+
+namespace {
+
+Expr* var(const char* name){
+    return new VarExpr(name);
+}
+
+Expr* num(int value){
+    return new IntExpr(value);
+}
+
+Stmt* increment(const char* name, int by){
+    return new AssignStmt(name, new BinaryExpr('+', var(name), num(by)));
+}
+
+// var i = 0; while (i < n) i = i + 1;
+std::vector<Stmt*> count(int n){
+    return { new VarDeclInitStmt("i", num(0)),
+             new WhileStmt(new BinaryExpr('<', var("i"), num(n)), increment("i", 1)) };
+}
+
+// var i = 0; var s = 0; while (i < n) { s = s + i; i = i + 1; }
+std::vector<Stmt*> sum(int n){
+    return { new VarDeclInitStmt("i", num(0)), new VarDeclInitStmt("s", num(0)),
+             new WhileStmt(new BinaryExpr('<', var("i"), num(n)),
+                           new BlockStmt({ new AssignStmt("s", new BinaryExpr('+', var("s"), var("i"))), increment("i", 1) })) };
+}
+
+// var i = 0; while (i < n) { var j = 0; while (j < 3) j = j + 1; i = i + 1; }
+std::vector<Stmt*> nested(int n){
+    Stmt* inner = new WhileStmt(new BinaryExpr('<', var("j"), num(3)), increment("j", 1));
+    return { new VarDeclInitStmt("i", num(0)),
+             new WhileStmt(new BinaryExpr('<', var("i"), num(n)),
+                           new BlockStmt({ new VarDeclInitStmt("j", num(0)), inner, increment("i", 1) })) };
+}
+
+double nsPerIteration(std::vector<Stmt*> program, int iterations, bool rotated){
+    if(rotated) rotateLoops(program);
+    checkDeclarations(program);
+
+    auto start = std::chrono::steady_clock::now();
+    for(Stmt* s : program){
+        execStmt(s);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    for(Stmt* s : program){
+        delete s;
+    }
+    return elapsed.count() / iterations;
+}
+
+void measure(const char* name, std::vector<Stmt*> (*make)(int), int n, int iterations){
+    double before = nsPerIteration(make(n), iterations, false);
+    double after = nsPerIteration(make(n), iterations, true);
+    printf("  %-28s %8.2f ns %8.2f ns\n", name, before, after);
+}
+
+} // namespace
+
+int main(){
+    const int n = 1000000;
+    printf("per iteration                    while     rotated\n");
+    measure("while (i < n) i = i + 1", count, n, n);
+    measure("s = s + i; i = i + 1", sum, n, n);
+    measure("inner loop of 3, per entry", nested, n / 4, n / 4);
+    return 0;
+}
@@ -0,0 +1,118 @@
+// benchmark for if-conversion (src/opt_ifconv.cpp).
+// runs small ifs through the interpreter on random inputs (the branch goes either way at
+// random) and on sorted inputs (the branch goes the same way for long runs), once as
+// written and once converted to a SelectExpr.
+//
+//   make bench
+
+#include "ast.hpp"
+#include "optimize.hpp"
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<random>
+#include<vector>
+
+void execStmt(Stmt* stmt);
+
+namespace {
+
+const int N = 1 << 16;
+const int ROUNDS = 10;
+
+// x = <input>; y = <input>; then the statement under test.
+// the inputs are written through IntExpr nodes the benchmark changes before every run
+struct Case {
+    IntExpr* xValue = new IntExpr(0);
+    IntExpr* yValue = new IntExpr(0);
+    std::vector<Stmt*> program;     // declarations, the two inputs, the statement
+
+    explicit Case(Stmt* test){
+        program = { new VarDeclStmt("x"), new VarDeclStmt("y"), new VarDeclStmt("m"), new VarDeclStmt("c"),
+                    new AssignStmt("x", xValue), new AssignStmt("y", yValue), test };
+    }
+
+    ~Case(){
+        for(Stmt* s : program){
+            delete s;
+        }
+    }
+
+    double nsPerRun(const std::vector<int>& xs, const std::vector<int>& ys){
+        checkDeclarations(program);
+        for(Stmt* s : program){
+            execStmt(s);
+        }
+        Stmt* setX = program[4];
+        Stmt* setY = program[5];
+        Stmt* test = program[6];
+
+        auto start = std::chrono::steady_clock::now();
+        for(int r = 0; r < ROUNDS; r++){
+            for(int i = 0; i < N; i++){
+                xValue->value = xs[i];
+                yValue->value = ys[i];
+                execStmt(setX);
+                execStmt(setY);
+                execStmt(test);
+            }
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / ((double)N * ROUNDS);
+    }
+};
+
+Expr* var(const char* name){
+    return new VarExpr(name);
+}
+
+// if (x > y) m = x; else m = y;
+Stmt* maxOf(){
+    return new IfStmt(new BinaryExpr('>', var("x"), var("y")),
+                      new AssignStmt("m", var("x")), new AssignStmt("m", var("y")));
+}
+
+// if (x < y) c = c + 1;
+Stmt* countLess(){
+    return new IfStmt(new BinaryExpr('<', var("x"), var("y")),
+                      new AssignStmt("c", new BinaryExpr('+', var("c"), new IntExpr(1))));
+}
+
+void measure(const char* name, Stmt* (*make)(), const std::vector<int>& xs, const std::vector<int>& ys){
+    Case branchy(make());
+    double before = branchy.nsPerRun(xs, ys);
+
+    Case converted(make());
+    int convertedBefore = optStats.ifsConverted;
+    convertIfs(converted.program);
+    if(optStats.ifsConverted == convertedBefore){
+        printf("  %-22s not converted\n", name);
+        return;
+    }
+    double after = converted.nsPerRun(xs, ys);
+    printf("  %-22s %8.2f ns %8.2f ns\n", name, before, after);
+}
+
+} // namespace
+
+int main(){
+    std::mt19937 rng(42);
+    std::vector<int> xs, ys;
+    for(int i = 0; i < N; i++){
+        xs.push_back((int)(rng() % 1000));
+        ys.push_back((int)(rng() % 1000));
+    }
+    // sorted: x < y for the first half, x > y for the second, so the branch is predictable
+    std::vector<int> sortedXs = xs;
+    std::sort(sortedXs.begin(), sortedXs.end());
+    std::vector<int> middle(N, 500);
+
+    printf("random data              if       select\n");
+    measure("if (x > y) m = x/y", maxOf, xs, ys);
+    measure("if (x < y) c = c + 1", countLess, xs, ys);
+
+    printf("\nsorted data              if       select\n");
+    measure("if (x > y) m = x/y", maxOf, sortedXs, middle);
+    measure("if (x < y) c = c + 1", countLess, sortedXs, middle);
+    return 0;
+}
@@ -0,0 +1,55 @@
+// benchmark for single-pass compilation (src/bytecode.cpp).
+// runs the interpreter on a generated run-once script: straight-line assignments with a
+// few short loops and ifs, the kind of program that runs every statement about once. the
+// tree is built, printed and walked (--no-opt; the optimizer takes far longer than the run
+// on a script this long), then the same script goes through --single-pass. whole runs are
+// timed, and the peak resident memory of each run is taken from wait4().
+//
+//   make bench
+
+#include "bench_util.hpp"
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+
+namespace {
+
+void writeScript(const std::string& path, int lines){
+    FILE* f = fopen(path.c_str(), "w");
+    for(int v = 0; v < 16; v++) fprintf(f, "var a%d = %d;\n", v, v);
+    for(int k = 0; k < lines; k++){
+        int a = k % 16, b = k * 7 % 16;
+        if(k % 50 == 0){
+            fprintf(f, "var i%d = 0;\nwhile (i%d < 4) { a%d = a%d + i%d; i%d = i%d + 1; }\n", k, k, a, b, k, k, k);
+        }else if(k % 5 == 0){
+            fprintf(f, "if (a%d > %d) { a%d = a%d - %d; } else { a%d = a%d * 2 + %d; }\n", a, k % 1000, b, b, k % 7, a, b, k % 9);
+        }else{
+            fprintf(f, "a%d = (a%d + %d) * 3 - a%d / 7 + (a%d - %d) * (a%d + 1);\n", a, b, k % 1000, a, b, k % 13, a);
+        }
+    }
+    fclose(f);
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    std::string parser = interpreterPath(argv[0]);
+    std::string script = "/tmp/mini_lang_singlepass_bench.txt";
+    const int lines = 20000;
+    const int runs = 3;
+
+    writeScript(script, lines);
+    const char* modes[][2] = {
+        { "tree, --no-opt", " --no-opt" },
+        { "--single-pass", " --single-pass" },
+    };
+    printf("%d lines, best of %d runs\n", lines, runs);
+    printf("  mode                    ms    peak MB\n");
+    for(auto& mode : modes){
+        Run r = bestRun(parser + mode[1] + " < " + script + " > /dev/null", runs);
+        printf("  %-16s %9.1f %10.1f\n", mode[0], r.ms, r.peakKb / 1024.0);
+    }
+
+    remove(script.c_str());
+    return 0;
+}
@@ -0,0 +1,53 @@
+// benchmark for speculative parallel parsing (src/specparse.cpp).
+// starts the interpreter on a generated script of many short top-level statements, with
+// the tokens scanned up front (--lex-threads=1) and parsed serially or in 2, 4, ... pieces
+// up to the number of cores (at least 4). --no-opt keeps the optimizer out of the times,
+// which are for the whole process.
+//
+//   make bench
+
+#include "bench_util.hpp"
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+#include<thread>
+
+namespace {
+
+// assignments, ifs and blocks over a fixed set of variables, cheap to run
+void writeScript(const std::string& path, int lines){
+    FILE* f = fopen(path.c_str(), "w");
+    for(int v = 0; v < 16; v++) fprintf(f, "var a%d = %d;\n", v, v);
+    for(int k = 0; k < lines; k++){
+        int a = k % 16, b = k * 7 % 16;
+        if(k % 3 == 0){
+            fprintf(f, "if (a%d > %d) { a%d = a%d + 1; } else { a%d = %d; }\n", a, k, b, b, a, k % 9);
+        }else{
+            fprintf(f, "a%d = (a%d + %d) * 3 - a%d / 7;\n", a, b, k, a);
+        }
+    }
+    fclose(f);
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    std::string parser = interpreterPath(argv[0]);
+    std::string script = "/tmp/mini_lang_specparse_bench.txt";
+    const int lines = 50000;
+    const int runs = 3;
+    unsigned cores = std::thread::hardware_concurrency();
+
+    writeScript(script, lines);
+    printf("%d lines, %u cores, ms per run\n", lines, cores);
+    std::string run = parser + " --no-opt --lex-threads=1";
+    double serial = msPerRun(run + " < " + script + " > /dev/null", runs);
+    printf("  serial          %9.1f\n", serial);
+    for(unsigned threads = 1; threads <= (cores > 4 ? cores : 4); threads *= 2){
+        std::string command = run + " --parse-threads=" + std::to_string(threads) + " < " + script + " > /dev/null";
+        printf("  %2u parsers      %9.1f\n", threads, msPerRun(command, runs));
+    }
+
+    remove(script.c_str());
+    return 0;
+}
@@ -0,0 +1,109 @@
+// microbenchmark for the strength reduction pass (src/opt_strength.cpp).
+// measures the cost of one multiplication / division by a constant, first as the bare
+// arithmetic and then as a whole expression node going through evalExpr.
+//
+//   make bench
+
+#include "ast.hpp"
+#include "optimize.hpp"
+#include<chrono>
+#include<cstdio>
+#include<random>
+#include<vector>
+
+int evalExpr(Expr* expr);
+void execStmt(Stmt* stmt);
+
+namespace {
+
+const int N = 1 << 16;
+const int ROUNDS = 200;
+
+std::vector<int> inputs;
+volatile int sink;
+
+template<typename F>
+double nsPerOp(F f){
+    auto start = std::chrono::steady_clock::now();
+    int sum = 0;
+    for(int r = 0; r < ROUNDS; r++){
+        for(int x : inputs){
+            sum += f(x);
+        }
+    }
+    sink = sum;
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ((double)N * ROUNDS);
+}
+
+// the constant is read through a volatile so the compiler can not lower the baseline itself
+void arithmetic(char op, int constant){
+    ConstArith lowered;
+    if(!(op == '*' ? lowerMultiply(constant, lowered) : lowerDivide(constant, lowered))){
+        printf("  x %c %-6d   not lowered\n", op, constant);
+        return;
+    }
+
+    volatile int hidden = constant;
+    int c = hidden;
+    double before = op == '*' ? nsPerOp([c](int x){ return (int)((unsigned)x * (unsigned)c); })
+                              : nsPerOp([c](int x){ return x / c; });
+    double after = nsPerOp([lowered](int x){ return lowered.apply(x); });
+    printf("  x %c %-6d %8.3f ns %8.3f ns\n", op, constant, before, after);
+}
+
+double nsPerEval(Expr* expr){
+    const int evals = N * 20;
+    auto start = std::chrono::steady_clock::now();
+    int sum = 0;
+    for(int i = 0; i < evals; i++){
+        sum += evalExpr(expr);
+    }
+    sink = sum;
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / evals;
+}
+
+// the same operation as an AST node, evaluated by the interpreter
+void interpreted(char op, int constant){
+    BinaryExpr expr(op, new VarExpr("x"), new IntExpr(constant));
+    double before = nsPerEval(&expr);
+    if(!(op == '*' ? lowerMultiply(constant, expr.lowered) : lowerDivide(constant, expr.lowered))){
+        printf("  x %c %-6d   not lowered\n", op, constant);
+        return;
+    }
+    double after = nsPerEval(&expr);
+    printf("  x %c %-6d %8.3f ns %8.3f ns\n", op, constant, before, after);
+}
+
+} // namespace
+
+int main(){
+    std::mt19937 rng(42);
+    for(int i = 0; i < N; i++){
+        inputs.push_back((int)rng());
+    }
+
+    const int factors[] = { 2, 10, 7, -8, 1000 };
+    const int divisors[] = { 2, 10, 7, -8, 1000 };
+
+    printf("bare arithmetic        before      after\n");
+    for(int f : factors){
+        arithmetic('*', f);
+    }
+    for(int d : divisors){
+        arithmetic('/', d);
+    }
+
+    VarDeclInitStmt decl("x", new IntExpr(-123456789));
+    execStmt(&decl);
+
+    printf("\nthrough evalExpr       before      after\n");
+    for(int f : factors){
+        interpreted('*', f);
+    }
+    for(int d : divisors){
+        interpreted('/', d);
+    }
+    return 0;
+}
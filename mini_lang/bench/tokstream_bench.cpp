@@ -0,0 +1,104 @@
+// benchmark for saved token streams (src/tokstream.cpp).
+// hands every token of a generated source to a stand-in for the parser, three ways: the
+// flex scanner, the hand-written scanner and the replay of a saved token stream. the
+// replay includes mapping and checking the file; saving it is timed separately.
+//
+//   make bench
+
+#include "ast.hpp"
+#include "parser.tab.hpp"
+#include "parlex.hpp"
+#include "tokstream.hpp"
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+#include<sys/stat.h>
+
+YYSTYPE yylval;
+extern FILE* yyin;
+int yylex();
+void yyrestart(FILE* file);
+
+namespace {
+
+std::string makeSource(size_t bytes){
+    std::string s;
+    char line[256];
+    for(int k = 0; s.size() < bytes; k++){
+        snprintf(line, sizeof(line), "// step %d: fold the running total into the accumulator\n", k);
+        s += line;
+        snprintf(line, sizeof(line), "var accumulatorValue%d = runningTotalCounter%d * %d + 12345;\n", k % 500, k % 97, k % 1000);
+        s += line;
+        snprintf(line, sizeof(line), "if (accumulatorValue%d >= %d) {\n    runningTotalCounter%d = runningTotalCounter%d - 1;\n} else {\n    x = x + 1;\n}\n", k % 500, k * 7, k % 97, k % 97);
+        s += line;
+    }
+    return s;
+}
+
+typedef int (*NextToken)();
+
+long drain(NextToken next){
+    long tokens = 0;
+    for(int t; (t = next()) != 0; tokens++){
+        if(t == IDENTIFIER) free(yylval.sval);
+    }
+    return tokens;
+}
+
+template<typename F>
+double bestMs(F f, int runs){
+    double best = 1e9;
+    for(int k = 0; k < runs; k++){
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if(elapsed.count() < best) best = elapsed.count();
+    }
+    return best;
+}
+
+} // namespace
+
+int main(){
+    const std::string path = "/tmp/mini_lang_tokstream_bench.tok";
+    const int runs = 3;
+    std::string source = makeSource(64 << 20);
+    std::string padded = source + std::string(scanPadding, '\0');
+    setScannerSource(source);
+
+    lexInParallel(padded.data(), source.size(), 1);
+    double save = bestMs([&]{ writeTokenStream(path, padded.data(), source.size(), lexedChunks()); }, 1);
+    struct stat info;
+    stat(path.c_str(), &info);
+
+    long tokens = 0;
+    double flex = bestMs([&]{
+        FILE* in = fmemopen((void*)source.data(), source.size(), "r");
+        yyrestart(in);
+        tokens = drain(yylex);
+        fclose(in);
+    }, runs);
+    double simd = bestMs([&]{
+        setScannerSource(source);
+        drain(simdLex);
+    }, runs);
+    long replayed = 0;
+    double replay = bestMs([&]{
+        if(!loadTokenStream(path)) exit(1);
+        replayed = drain(replayLex);
+    }, runs);
+    if(replayed != tokens){
+        fprintf(stderr, "replayed %ld tokens, expected %ld\n", replayed, tokens);
+        return 1;
+    }
+
+    printf("%zu bytes of source, %ld tokens, token file %lld bytes (saved in %.0f ms)\n",
+           source.size(), tokens, (long long)info.st_size, save);
+    printf("  source             ms   Mtokens/s\n");
+    printf("  flex         %8.1f %10.1f\n", flex, tokens / flex / 1e3);
+    printf("  simdLex      %8.1f %10.1f\n", simd, tokens / simd / 1e3);
+    printf("  replay       %8.1f %10.1f\n", replay, tokens / replay / 1e3);
+    remove(path.c_str());
+    return 0;
+}
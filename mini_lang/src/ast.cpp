@@ -5,12 +5,61 @@
 #include<map>
 #include<string>
 #include<stdexcept>
+#include<climits>
 
 void printSymbolTable();
+void execStmt(Stmt* stmt);
 void printExpr(Expr* expr, int indent);
 void printStmt(Stmt* stmt, int indent);
 
-static std::map<std::string, int> symbolTable;
+// symbol table. every name gets a slot the first time the interpreter meets it and the node
+// remembers that slot, so later lookups index an array instead of searching the map.
+// variableSlots is ordered by name, which keeps the dump at the end sorted
+static std::map<std::string, int> variableSlots;
+static std::vector<int> values;             // indexed by slot
+static std::vector<char> declaredSlots;     // 1 once a var statement ran for the slot
+
+static int slotOf(const std::string& name){
+    auto it = variableSlots.find(name);
+    if(it != variableSlots.end()){
+        return it->second;
+    }
+    values.push_back(0);
+    declaredSlots.push_back(0);
+    return variableSlots[name] = (int)values.size() - 1;
+}
+
+static int resolve(int& slot, const std::string& name){
+    if(slot < 0){
+        slot = slotOf(name);
+    }
+    return slot;
+}
+
+static std::vector<int> tempValues;     // optimizer temporaries, indexed by slot
+
+BlockStmt* (*parseLazyBlock)(LazyBlockStmt* lazy) = nullptr;
+
+int newTempSlot(){
+    tempValues.push_back(0);
+    return (int)tempValues.size() - 1;
+}
+
+int variableSlot(const std::string& name){
+    return slotOf(name);
+}
+
+int& variableValue(int slot){
+    return values[slot];
+}
+
+char& variableDeclared(int slot){
+    return declaredSlots[slot];
+}
+
+int& tempValue(int slot){
+    return tempValues[slot];
+}
 
 int evalExpr(Expr* expr){
     //integer literals
@@ -33,13 +82,14 @@ int evalExpr(Expr* expr){
      *   1.extract variable name from the node
      *   2.search for it in the symbol table
      *   3.if found: return its value else error (undefined variable)
+     *   sites the analysis in opt_declared.cpp proved declared skip the check
     */
     if(auto varExpr=dynamic_cast<VarExpr*>(expr)){
-        auto it=symbolTable.find(varExpr->name);
-        if(it==symbolTable.end()){
+        int slot = resolve(varExpr->slot, varExpr->name);
+        if(!varExpr->provenDeclared && !declaredSlots[slot]){
             throw std::runtime_error("Undefined variable: " + varExpr->name);
         }
-        return it->second;
+        return values[slot];
     }
 
     //binary expression
@@ -52,6 +102,11 @@ int evalExpr(Expr* expr){
     */
 
     if(auto binExpr=dynamic_cast<BinaryExpr*>(expr)){
+        // by a literal: no need to evaluate the right operand (see ConstArith in ast.hpp)
+        if(binExpr->lowered.kind){
+            return binExpr->lowered.apply(evalExpr(binExpr->left));
+        }
+
         int left = evalExpr(binExpr->left);
         int right= evalExpr(binExpr->right);
 
@@ -60,7 +115,7 @@ int evalExpr(Expr* expr){
             case '-': return left-right;
             case '*': return left*right;
             case '/':
-                if(right == 0){
+                if(!binExpr->divisorNonZero && right == 0){
                     throw std::runtime_error("Division by zero");
                 }
                 return left/right;
@@ -78,11 +133,158 @@ int evalExpr(Expr* expr){
         }
     }
 
+    //optimizer temporary
+    if(auto tempExpr = dynamic_cast<TempExpr*>(expr)){
+        return tempValues[tempExpr->slot];
+    }
+
+    if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+        return tempValues[tempStore->slot] = evalExpr(tempStore->expr);
+    }
+
+    //branchless select (see SelectExpr in ast.hpp)
+    if(auto select = dynamic_cast<SelectExpr*>(expr)){
+        unsigned mask = 0u - (unsigned)(evalExpr(select->condition) != 0);
+        unsigned ifTrue = (unsigned)evalExpr(select->ifTrue);
+        unsigned ifFalse = (unsigned)evalExpr(select->ifFalse);
+        return (int)((ifTrue & mask) | (ifFalse & ~mask));
+    }
+
     throw std::runtime_error("Unknown expression type");
 
 }
 
 
+// closed form loops (see ClosedFormWhileStmt in ast.hpp)
+
+// number of times the body of "counter cmp bound" runs, given that the condition held for
+// start. returns -1 when that can not be computed safely (the loop would never end or the
+// counter would wrap around before the condition fails)
+static long long tripCount(char cmp, long long start, long long bound, long long step){
+    long long trips;
+    switch(cmp){
+        case '<':
+            if(step <= 0) return -1;
+            trips = (bound - start + step - 1) / step;
+            break;
+        case 'L':
+            if(step <= 0) return -1;
+            trips = (bound - start) / step + 1;
+            break;
+        case '>':
+            if(step >= 0) return -1;
+            trips = (start - bound - step - 1) / -step;
+            break;
+        case 'G':
+            if(step >= 0) return -1;
+            trips = (start - bound) / -step + 1;
+            break;
+        case 'N':
+            if(step == 0 || (bound - start) % step != 0) return -1;
+            trips = (bound - start) / step;
+            if(trips <= 0) return -1;
+            break;
+        default:
+            return -1;
+    }
+
+    long long last = start + trips * step;  // counter value when the condition fails
+    if(last > INT_MAX || last < INT_MIN) return -1;
+    return trips;
+}
+
+// n choose k, reduced mod 2^32. exact for the n < 2^33, k <= 4 we need
+static unsigned choose(long long n, int k){
+    if(n < k) return 0;
+    __int128 c = 1;
+    for(int j = 1; j <= k; j++){
+        c = c * (n - j + 1) / j;
+    }
+    return (unsigned)c;
+}
+
+static void execClosedForm(ClosedFormWhileStmt* loop){
+    if(evalExpr(loop->condition) == 0){
+        return;
+    }
+
+    auto cond = static_cast<BinaryExpr*>(loop->condition);
+    long long start = values[slotOf(loop->counter)];
+    long long bound = evalExpr(loop->counterOnLeft ? cond->right : cond->left);
+    long long step = 0;
+    for(size_t i = 0; i < loop->inductions.size(); i++){
+        if(loop->inductions[i] == loop->counter) step = loop->steps[i];
+    }
+
+    long long trips = tripCount(loop->cmp, start, bound, step);
+    const int samples = loop->degree + 1;
+    if(trips <= samples){
+        // nothing to gain (or nothing we can prove): run it as written.
+        // the condition was already checked once above
+        do{
+            execStmt(loop->body);
+        }while(evalExpr(loop->condition) != 0);
+        return;
+    }
+
+    // run the first iterations normally, recording what each of them added to every
+    // accumulator and what value every derived variable got. all arithmetic is mod 2^32,
+    // which is exactly what the interpreter's int math does on overflow
+    size_t accs = loop->accumulators.size();
+    std::vector<std::vector<unsigned>> delta(accs), value(loop->derived.size());
+    for(int k = 0; k < samples; k++){
+        std::vector<unsigned> before(accs);
+        for(size_t a = 0; a < accs; a++){
+            before[a] = (unsigned)values[slotOf(loop->accumulators[a])];
+        }
+
+        execStmt(loop->body);
+
+        for(size_t a = 0; a < accs; a++){
+            delta[a].push_back((unsigned)values[slotOf(loop->accumulators[a])] - before[a]);
+        }
+        for(size_t d = 0; d < loop->derived.size(); d++){
+            value[d].push_back((unsigned)values[slotOf(loop->derived[d])]);
+        }
+    }
+
+    // newton forward differences: f(k) = sum_j diff[j] * C(k, j), so
+    // sum_{k<n} f(k) = sum_j diff[j] * C(n, j+1)
+    auto differences = [](std::vector<unsigned> f){
+        for(size_t j = 1; j < f.size(); j++){
+            for(size_t k = f.size() - 1; k >= j; k--){
+                f[k] -= f[k-1];
+            }
+        }
+        return f;
+    };
+
+    for(size_t a = 0; a < accs; a++){
+        std::vector<unsigned> diff = differences(delta[a]);
+        unsigned total = (unsigned)values[slotOf(loop->accumulators[a])];
+        for(int j = 0; j < samples; j++){
+            total += diff[j] * (choose(trips, j + 1) - choose(samples, j + 1));
+        }
+        values[slotOf(loop->accumulators[a])] = (int)total;
+    }
+
+    for(size_t d = 0; d < loop->derived.size(); d++){
+        std::vector<unsigned> diff = differences(value[d]);
+        unsigned last = 0;
+        for(int j = 0; j < samples; j++){
+            last += diff[j] * choose(trips - 1, j);
+        }
+        values[slotOf(loop->derived[d])] = (int)last;
+    }
+
+    for(size_t i = 0; i < loop->inductions.size(); i++){
+        unsigned v = (unsigned)values[slotOf(loop->inductions[i])];
+        v += (unsigned)loop->steps[i] * (unsigned)(trips - samples);
+        values[slotOf(loop->inductions[i])] = (int)v;
+    }
+}
+
+
 //statement executor
 /*
 * how it works:
@@ -110,7 +312,9 @@ int evalExpr(Expr* expr){
 void execStmt(Stmt* stmt){ //take a statement ast node and execute it (perform its action)
     // variable declaration (create variable in symbol table with value 0)
     if(auto decl=dynamic_cast<VarDeclStmt*>(stmt)){
-        symbolTable[decl->name]=0;
+        int slot = resolve(decl->slot, decl->name);
+        values[slot]=0;
+        declaredSlots[slot]=1;
         return;
     }
 
@@ -118,7 +322,9 @@ void execStmt(Stmt* stmt){ //take a statement ast node and execute it (perform i
     // variable declaration with initialization (evaluate the initialization expression and create variable in symbol table with that value)
     if(auto declInit = dynamic_cast<VarDeclInitStmt*> (stmt)){
         int value=evalExpr(declInit->expr);
-        symbolTable[declInit->name]=value;
+        int slot = resolve(declInit->slot, declInit->name);
+        values[slot]=value;
+        declaredSlots[slot]=1;
         return;
     }
 
@@ -139,14 +345,18 @@ void execStmt(Stmt* stmt){ //take a statement ast node and execute it (perform i
      *   after:x now has value 11
     */
     if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
-        auto it=symbolTable.find(assign->name);
-        if(it==symbolTable.end()){
+        int slot = resolve(assign->slot, assign->name);
+        if(!assign->provenDeclared && !declaredSlots[slot]){
             throw std::runtime_error("Cannot assign to undeclated variable: "+assign->name);
         }
 
         int value= evalExpr(assign->expr);
 
-        symbolTable[assign->name]=value;
+        values[slot]=value;
+        for(const TempStep& step : assign->steps){
+            unsigned by = step.by < 0 ? (unsigned)step.amount : (unsigned)tempValues[step.by];
+            tempValues[step.slot] = (int)((unsigned)tempValues[step.slot] + by);
+        }
         return;
     }
 
@@ -183,6 +393,19 @@ void execStmt(Stmt* stmt){ //take a statement ast node and execute it (perform i
      *
     */
 
+    if(auto closedForm=dynamic_cast<ClosedFormWhileStmt*>(stmt)){
+        execClosedForm(closedForm);
+        return;
+    }
+
+    //rotated loop (see DoWhileStmt in ast.hpp), the guard in front of it did the first test
+    if(auto doWhile=dynamic_cast<DoWhileStmt*>(stmt)){
+        do{
+            execStmt(doWhile->body);
+        }while(evalExpr(doWhile->condition) != 0);
+        return;
+    }
+
     if(auto whileStmt=dynamic_cast<WhileStmt*>(stmt)){
 
         while(evalExpr(whileStmt -> condition) !=0){
@@ -222,14 +445,31 @@ void execStmt(Stmt* stmt){ //take a statement ast node and execute it (perform i
         return;
     }
 
+    //optimizer temporary (see TempExpr in ast.hpp)
+    if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+        tempValues[tempAssign->slot] = evalExpr(tempAssign->expr);
+        return;
+    }
+
+    //block not parsed yet (see LazyBlockStmt in ast.hpp)
+    if(auto lazy = dynamic_cast<LazyBlockStmt*>(stmt)){
+        if(!lazy->block){
+            lazy->block = parseLazyBlock(lazy);
+        }
+        execStmt(lazy->block);
+        return;
+    }
+
 
     throw std::runtime_error("Unknown statement type");
 }
 
 void printSymbolTable(){
     std::cout<<"\n---- Symbol Table ----\n";
-    for(const auto& entry:symbolTable){
-        std::cout<<entry.first<<" = "<<entry.second<<"\n";
+    for(const auto& entry:variableSlots){
+        if(declaredSlots[entry.second]){
+            std::cout<<entry.first<<" = "<<values[entry.second]<<"\n";
+        }
     }
 }
 
@@ -276,6 +516,28 @@ void printExpr(Expr* expr, int indent) {
         printExpr(binExpr->right, indent+1);
         return;
     }
+
+    if (auto tempExpr=dynamic_cast<TempExpr*>(expr)) {
+        printIndent(indent);
+        std::cout<<"TempExpr(t"<<tempExpr->slot<<")\n";
+        return;
+    }
+
+    if (auto tempStore=dynamic_cast<TempStoreExpr*>(expr)) {
+        printIndent(indent);
+        std::cout<<"TempStoreExpr(t"<<tempStore->slot<<")\n";
+        printExpr(tempStore->expr, indent+1);
+        return;
+    }
+
+    if (auto select=dynamic_cast<SelectExpr*>(expr)) {
+        printIndent(indent);
+        std::cout<<"SelectExpr\n";
+        printExpr(select->condition, indent+1);
+        printExpr(select->ifTrue, indent+1);
+        printExpr(select->ifFalse, indent+1);
+        return;
+    }
 }
 
 // print a statement tree
@@ -319,7 +581,13 @@ void printStmt(Stmt* stmt, int indent) {
 
     if (auto whileStmt=dynamic_cast<WhileStmt*>(stmt)) {
         printIndent(indent);
-        std::cout<<"WhileStmt\n";
+        if (dynamic_cast<ClosedFormWhileStmt*>(stmt)) {
+            std::cout<<"ClosedFormWhileStmt\n";
+        } else if (dynamic_cast<DoWhileStmt*>(stmt)) {
+            std::cout<<"DoWhileStmt\n";
+        } else {
+            std::cout<<"WhileStmt\n";
+        }
         printIndent(indent+1);
         std::cout<<"Condition:\n";
         printExpr(whileStmt->condition,indent+2);
@@ -337,6 +605,23 @@ void printStmt(Stmt* stmt, int indent) {
         }
         return;
     }
+
+    if (auto tempAssign=dynamic_cast<TempAssignStmt*>(stmt)) {
+        printIndent(indent);
+        std::cout<<"TempAssignStmt(t"<<tempAssign->slot<<")\n";
+        printExpr(tempAssign->expr, indent+1);
+        return;
+    }
+
+    if (auto lazy=dynamic_cast<LazyBlockStmt*>(stmt)) {
+        if (lazy->block) {
+            printStmt(lazy->block, indent);
+            return;
+        }
+        printIndent(indent);
+        std::cout<<"BlockStmt (not parsed yet, "<<(lazy->end - lazy->begin)<<" bytes)\n";
+        return;
+    }
 }
 
 
@@ -1,19 +1,40 @@
 #ifndef AST_HPP
 #define AST_HPP
 
+#include<climits>
+#include<cstdint>
 #include<memory>
 #include<string>
 #include<vector>
 
+// 128 bit structural hash of a subtree (asthash.cpp)
+struct Hash128 {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    bool operator==(const Hash128& o) const { return hi == o.hi && lo == o.lo; }
+    bool operator!=(const Hash128& o) const { return !(*this == o); }
+    std::string hex() const;    // 32 hex digits
+};
+
 struct  ASTNode     //base class for all the nodes
 {
+    Hash128 hash;   // merkle hash of the subtree as parsed, see hashNode()
     virtual ~ASTNode()=default; //when deleting a node, delete it properly (without this: child objects may not be destroyed correctly, memory problems can happen)
 };
 
 
 // -------expressions (code that calculates and return a value) ----------
 
-struct Expr: ASTNode{};     //base class for all the expressions
+struct Expr: ASTNode{     //base class for all the expressions
+    bool interned = false;  // shared node owned by the hash-consing table (hashcons.cpp)
+};
+
+// deletes an expression owned by its parent. interned nodes may have other parents and are
+// only deleted by releaseInterned()
+inline void releaseExpr(Expr* expr){
+    if(expr && !expr->interned) delete expr;
+}
 
 
 //integer literal: 10
@@ -29,23 +50,120 @@ struct IntExpr: Expr{   //store the number that apppears directly in the code va
 
 struct VarExpr : Expr {     //stores the name of a variable when it's used in an expression
     std::string name;
+    int slot = -1;              // symbol table slot, looked up on first use (ast.cpp)
+    bool provenDeclared = false;    // declared on every path reaching here, no check needed (opt_declared.cpp)
     explicit VarExpr(const std::string& n): name(n) {}
 };
 
+// multiplication / division by a literal, lowered by the optimizer (opt_strength.cpp).
+// kind 0 means not lowered. multiplications become shifts and at most one add / subtract,
+// done on unsigned so overflow wraps exactly like '*'. divisions by a power of two become a
+// shift with a rounding fix for negative operands, all others a multiply-high by a magic
+// number and a shift (hacker's delight, chapter 10); both truncate toward zero like '/'
+struct ConstArith {
+    char kind = 0;
+    int shiftA = 0;
+    int shiftB = 0;
+    int magic = 0;
+
+    int apply(int x) const {
+        unsigned u = (unsigned)x;
+        switch(kind){
+            case 'S': return (int)(u << shiftA);                        // x * 2^a
+            case 'N': return (int)(0u - (u << shiftA));                 // x * -2^a
+            case '+': return (int)((u << shiftA) + (u << shiftB));      // x * (2^a + 2^b)
+            case '-': return (int)((u << shiftA) - (u << shiftB));      // x * (2^a - 2^b)
+            case 'M': return (int)(0u - (u << shiftA) - (u << shiftB)); // x * -(2^a + 2^b)
+            case 'P':                                                   // x / 2^a
+            case 'Q': {                                                 // x / -2^a
+                unsigned bias = (unsigned)(x >> 31) >> (32 - shiftA);
+                int q = (int)(u + bias) >> shiftA;
+                return kind == 'P' ? q : -q;
+            }
+            default: {                                                  // x / d
+                int q = (int)(((long long)magic * x) >> 32);
+                if(kind == 'A') q = (int)((unsigned)q + u);             // magic < 0 < d
+                if(kind == 'B') q = (int)((unsigned)q - u);             // d < 0 < magic
+                q >>= shiftA;
+                return q + (int)((unsigned)q >> 31);
+            }
+        }
+    }
+};
+
 // binary expression: a+b
 struct BinaryExpr : Expr{       //stores an operation between two expressions
     char op;        // operation to perform(+,-,*,/....)
     Expr* left;     // expr* because it can be int,var,expression
     Expr* right;
 
+    // filled in by the value range analysis (opt_range.cpp) for the backends
+    int minValue = INT_MIN;         // the result always lies in [minValue, maxValue]
+    int maxValue = INT_MAX;
+    bool divisorNonZero = false;    // '/': the right operand is never 0, no check needed
+
+    ConstArith lowered;     // '*' / '/' by a literal right operand (opt_strength.cpp)
+
     BinaryExpr(char oper, Expr* l, Expr* r): op(oper), left(l), right(r) {}
 
     ~BinaryExpr() {     //without this memory leak, the child nodes would stay in memmory forever
-        delete left;
-        delete right;
+        releaseExpr(left);
+        releaseExpr(right);
+    }
+};
+
+// temporary introduced by the optimizer, never written by the user.
+// reads the value last stored into the slot by a TempAssignStmt.
+// temporaries live outside the symbol table so they never show up in its dump.
+struct TempExpr : Expr {
+    int slot;
+    explicit TempExpr(int s) : slot(s) {}
+};
+
+int newTempSlot();  // allocates a fresh temporary (ast.cpp)
+
+// evaluates expr, stores the result into a temporary and returns it.
+// used where a value is computed for the first time and read again later via TempExpr.
+struct TempStoreExpr : Expr {
+    int slot;
+    Expr* expr;
+
+    TempStoreExpr(int s, Expr* e) : slot(s), expr(e) {}
+
+    ~TempStoreExpr() {
+        releaseExpr(expr);
+    }
+};
+
+// condition ? ifTrue : ifFalse, built by the optimizer from an if that only picks which
+// value to assign (see opt_ifconv.cpp). all three operands are always evaluated and the
+// result is picked with a mask instead of a branch, so they must not be able to throw
+struct SelectExpr : Expr {
+    Expr* condition;
+    Expr* ifTrue;
+    Expr* ifFalse;
+
+    SelectExpr(Expr* c, Expr* t, Expr* f) : condition(c), ifTrue(t), ifFalse(f) {}
+
+    ~SelectExpr() {
+        releaseExpr(condition);
+        releaseExpr(ifTrue);
+        releaseExpr(ifFalse);
     }
 };
 
+// expression nodes for the parser (hashcons.cpp). normally every call allocates a new node.
+// with hash-consing enabled (--hash-cons) structurally equal expressions come back as one
+// shared, interned node, which turns the expression trees into a DAG. interned nodes must
+// not be changed or deleted; releaseInterned() frees all of them at the end
+Expr* makeIntExpr(int value);
+Expr* makeVarExpr(const std::string& name);
+Expr* makeBinaryExpr(char op, Expr* left, Expr* right);
+void enableHashConsing();
+bool hashConsingEnabled();
+void releaseInterned();
+void printHashConsStats();      // --stats: nodes and bytes with and without sharing
+
 // ------------- statements( does not return values) ----------------
 // statements means code that perfoems an action or controls flows 
 //like var x=10, x=10, if(x>3){...}, while(i<2){....}
@@ -57,10 +175,19 @@ struct Stmt : ASTNode{};
 // vardecstmt("x") -> type: vardeclstmt, name: "x" default value is 0
 struct VarDeclStmt : Stmt{
     std::string name;
+    int slot = -1;
     explicit VarDeclStmt(const std::string& n) : name(n) {}
 };
 
 
+// optimizer temporary stepped along with an induction variable (see opt_ivsr.cpp):
+// tempValues[slot] += by < 0 ? amount : tempValues[by], wrapping
+struct TempStep {
+    int slot;
+    int by;
+    int amount;
+};
+
 // x=expr (x=5+3)
 // execution: when this node is executed:
 // evaluate the expression on right (e.g, 5 + 3 = 8)
@@ -69,11 +196,14 @@ struct VarDeclStmt : Stmt{
 struct AssignStmt : Stmt {
     std::string name;
     Expr* expr;
+    int slot = -1;
+    bool provenDeclared = false;    // see VarExpr
+    std::vector<TempStep> steps;    // applied in order after the assignment
 
     AssignStmt(const std::string& n, Expr* e) : name(n), expr(e) {}
 
     ~AssignStmt() {
-        delete expr;
+        releaseExpr(expr);
     }
 };
 
@@ -87,11 +217,12 @@ struct VarDeclInitStmt : Stmt{
     std::string name;
 
     Expr* expr;
+    int slot = -1;
 
     VarDeclInitStmt(const std:: string& n, Expr* e) : name(n), expr(e) {}
 
     ~VarDeclInitStmt(){
-        delete expr;
+        releaseExpr(expr);
     }
 };
 
@@ -123,7 +254,7 @@ struct IfStmt : Stmt{
 
     ~IfStmt(){
         
-        delete condition;
+        releaseExpr(condition);
         delete thenStmt;
 
         if(elseStmt) delete elseStmt;
@@ -152,11 +283,61 @@ struct WhileStmt : Stmt {
     WhileStmt(Expr* cond, Stmt* b) : condition(cond), body(b) {}
 
     ~WhileStmt(){
-        delete condition;
+        releaseExpr(condition);
         delete body;
     }
 };
 
+// while loop whose final state has a closed form (built by the optimizer, see opt_scev.cpp)
+/*
+ *   while (i < n) {             i: induction variable, steps by a constant
+ *       sum = sum + i * 2;      sum: accumulator, adds a polynomial in the trip number
+ *       last = i * i;           last: derived, a polynomial in the trip number
+ *       i = i + 1;
+ *   }
+ *
+ * at runtime the trip count is computed from the counter, the bound and the step, the
+ * first degree+1 iterations run normally to sample every variable, and the values after
+ * the last iteration are computed directly from those samples. when the trip count can not
+ * be proven (wrong direction, counter would overflow) the loop simply runs as written.
+ * it is still a WhileStmt, so code that does not know about it treats it as a plain loop.
+*/
+struct ClosedFormWhileStmt : WhileStmt {
+
+    std::string counter;        // induction variable tested by the condition
+    bool counterOnLeft;         // counter is the left operand of the condition
+    char cmp;                   // condition operator, normalized to "counter cmp bound"
+
+    std::vector<std::string> inductions;    // v = v + step (includes the counter)
+    std::vector<int> steps;
+    std::vector<std::string> accumulators;  // s = s + f(trip), s = s - f(trip)
+    std::vector<std::string> derived;       // x = f(trip)
+    int degree = 0;                         // highest degree of any f
+
+    ClosedFormWhileStmt(Expr* cond, Stmt* b) : WhileStmt(cond, b) {}
+};
+
+// do body while (condition), built by the optimizer from a while loop behind a guard
+// (see opt_rotate.cpp). the body runs once before the condition is tested for the first
+// time, every later test happens at the bottom. like ClosedFormWhileStmt it is still a
+// WhileStmt: code that only needs "body may run again after the condition" can treat it
+// as one.
+struct DoWhileStmt : WhileStmt {
+    DoWhileStmt(Expr* cond, Stmt* b) : WhileStmt(cond, b) {}
+};
+
+// stores a value into an optimizer temporary (see TempExpr)
+struct TempAssignStmt : Stmt {
+    int slot;
+    Expr* expr;
+
+    TempAssignStmt(int s, Expr* e) : slot(s), expr(e) {}
+
+    ~TempAssignStmt() {
+        releaseExpr(expr);
+    }
+};
+
 // block statement: {stmt1;stmt2; stmt3; ... }
 /*
 *   {
@@ -179,6 +360,51 @@ struct BlockStmt : Stmt {
     }
 };
 
+// a block that is not parsed yet (--lazy-blocks, lazyblock.cpp). the first pass only
+// matched its braces; execStmt parses the text between them through parseLazyBlock the
+// first time it gets here and runs the block from then on
+struct LazyBlockStmt : Stmt {
+    const char* begin;          // the text between the braces, in the source being parsed
+    const char* end;
+    BlockStmt* block = nullptr; // once parsed
+
+    LazyBlockStmt(const char* b, const char* e) : begin(b), end(e) {}
+    ~LazyBlockStmt(){ delete block; }
+};
+
+// set by enableLazyBlocks() (lazyblock.cpp), the parser is not part of the tree code
+extern BlockStmt* (*parseLazyBlock)(LazyBlockStmt* lazy);
+
+
+// merkle hashing (asthash.cpp). a node's hash covers its kind, its operator / literal /
+// identifier, what the optimizer attached to it that changes how it runs (steps, closed
+// forms, lowered arithmetic) and the hashes of its children, so equal hashes mean structurally equal
+// subtrees (up to collisions of a 128 bit hash) and the same program always gets the same
+// hash, across runs and machines. the parser hashes every node bottom-up as it builds it.
+// nodes the optimizer creates or rewrites keep no valid hash until rehashTree() is called
+void hashNode(ASTNode* node);               // from the hashes already stored in the children
+Hash128 rehashTree(ASTNode* node);          // whole subtree, stores every hash on the way
+Hash128 programHash(const std::vector<Stmt*>& stmts);
+Hash128 hashBytes(const char* bytes, size_t size);    // same hash function over raw bytes
+
+template<typename T>
+T* hashed(T* node){     // for parser actions: $$ = hashed(new IfStmt(...))
+    hashNode(node);
+    return node;
+}
+
+// interpreter state (ast.cpp), for code that runs programs without the tree (astbin.cpp).
+// the references stay valid until the next new name or temporary
+int variableSlot(const std::string& name);     // the name's symbol table slot, created on first use
+int& variableValue(int slot);
+char& variableDeclared(int slot);              // 1 once a var statement ran for the slot
+int& tempValue(int slot);
+
+// binary ast (astbin.cpp). a position-independent encoding of a program: nodes refer to
+// their children by relative offsets and to names by an index into one identifier table,
+// so a file can be mapped anywhere and run in place, without building any nodes
+bool writeAstBinary(const std::string& path, const std::vector<Stmt*>& stmts);
+bool runAstBinary(const std::string& path);    // false (and a message) for a bad file
 
 #endif
 
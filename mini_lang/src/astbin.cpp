@@ -0,0 +1,497 @@
+// binary ast: write a program to a file and run it straight from the mapped file.
+// the file is an array of 32 bit words:
+//
+//   header      magic "MLASTBIN", format version, byte order mark, name count, offset of
+//               the name table, temporaries, statement count, offset of the root list
+//   nodes       every node after its children
+//   roots       offsets of the top-level statements
+//   names       (offset, length) per identifier, then the characters
+//
+// a node starts with a word holding its kind, its operator and a small count, followed by
+// its fields. children are word offsets relative to the node itself, always negative
+// because children come first; 0 means "no child" (a missing else). variables are indices
+// into the name table, temporaries are numbered from 0. nothing in the file is an address
+// and nothing is patched after loading, so the runner reads the nodes where mmap put them.
+//
+//   I value     V name      B l r (op)        T slot      S slot e      ? c t f
+//   d name      i name e    a name e steps    t slot e    f c t e (has else)
+//   w c body    o c body    k count stmts...
+//
+// the runner checks every node once when the file is opened (kind, size, children of the
+// right kind, indices in range), so a damaged file is rejected instead of crashing it, and
+// then executes with the same semantics and errors as execStmt(). what the optimizer only
+// adds for speed is not stored: proven declarations and ranges keep their checks, lowered
+// arithmetic is a plain '*' or '/', and a closed form loop is stored as the loop it came
+// from.
+
+#include "ast.hpp"
+#include<cctype>
+#include<cstdio>
+#include<cstring>
+#include<fcntl.h>
+#include<map>
+#include<stdexcept>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+namespace {
+
+const char magic[8] = { 'M', 'L', 'A', 'S', 'T', 'B', 'I', 'N' };
+const uint32_t formatVersion = 1;
+const uint32_t byteOrderMark = 0x01020304;
+
+// header words after the magic
+enum { versionWord, byteOrderWord, nameCountWord, namesAtWord, tempCountWord, stmtCountWord, rootsAtWord, headerFields };
+const uint32_t headerWords = sizeof(magic) / 4 + headerFields;
+
+uint32_t nodeHeader(char kind, char op = 0, uint32_t count = 0){
+    return (uint8_t)kind | (uint32_t)(uint8_t)op << 8 | count << 16;
+}
+
+char kindOf(const uint32_t* node){ return (char)(node[0] & 0xff); }
+char opOf(const uint32_t* node){ return (char)(node[0] >> 8 & 0xff); }
+uint32_t countOf(const uint32_t* node){ return node[0] >> 16; }
+
+// ---------- writing ----------
+
+struct Encoder {
+    std::vector<uint32_t> words = std::vector<uint32_t>(headerWords);
+    std::map<std::string, uint32_t> index;
+    std::vector<std::string> names;
+    uint32_t temps = 0;
+
+    uint32_t name(const std::string& n){
+        auto it = index.find(n);
+        if(it != index.end()) return it->second;
+        names.push_back(n);
+        return index[n] = (uint32_t)names.size() - 1;
+    }
+
+    uint32_t temp(int slot){
+        if((uint32_t)slot + 1 > temps) temps = (uint32_t)slot + 1;
+        return (uint32_t)slot;
+    }
+
+    // starts a node, its child words are written relative to the returned position
+    uint32_t begin(uint32_t header){
+        words.push_back(header);
+        return (uint32_t)words.size() - 1;
+    }
+
+    void child(uint32_t node, uint32_t at){
+        words.push_back((uint32_t)((int32_t)at - (int32_t)node));
+    }
+
+    uint32_t expr(Expr* e);
+    uint32_t stmt(Stmt* s);
+};
+
+uint32_t Encoder::expr(Expr* e){
+    if(auto intExpr = dynamic_cast<IntExpr*>(e)){
+        uint32_t node = begin(nodeHeader('I'));
+        words.push_back((uint32_t)intExpr->value);
+        return node;
+    }
+    if(auto varExpr = dynamic_cast<VarExpr*>(e)){
+        uint32_t node = begin(nodeHeader('V'));
+        words.push_back(name(varExpr->name));
+        return node;
+    }
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(e)){
+        uint32_t left = expr(binExpr->left);
+        uint32_t right = expr(binExpr->right);
+        uint32_t node = begin(nodeHeader('B', binExpr->op));
+        child(node, left);
+        child(node, right);
+        return node;
+    }
+    if(auto tempExpr = dynamic_cast<TempExpr*>(e)){
+        uint32_t node = begin(nodeHeader('T'));
+        words.push_back(temp(tempExpr->slot));
+        return node;
+    }
+    if(auto tempStore = dynamic_cast<TempStoreExpr*>(e)){
+        uint32_t value = expr(tempStore->expr);
+        uint32_t node = begin(nodeHeader('S'));
+        words.push_back(temp(tempStore->slot));
+        child(node, value);
+        return node;
+    }
+    auto select = static_cast<SelectExpr*>(e);
+    uint32_t condition = expr(select->condition);
+    uint32_t ifTrue = expr(select->ifTrue);
+    uint32_t ifFalse = expr(select->ifFalse);
+    uint32_t node = begin(nodeHeader('?'));
+    child(node, condition);
+    child(node, ifTrue);
+    child(node, ifFalse);
+    return node;
+}
+
+uint32_t Encoder::stmt(Stmt* s){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(s)){
+        uint32_t node = begin(nodeHeader('d'));
+        words.push_back(name(decl->name));
+        return node;
+    }
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(s)){
+        uint32_t value = expr(declInit->expr);
+        uint32_t node = begin(nodeHeader('i'));
+        words.push_back(name(declInit->name));
+        child(node, value);
+        return node;
+    }
+    if(auto assign = dynamic_cast<AssignStmt*>(s)){
+        uint32_t value = expr(assign->expr);
+        uint32_t node = begin(nodeHeader('a', 0, (uint32_t)assign->steps.size()));
+        words.push_back(name(assign->name));
+        child(node, value);
+        for(const TempStep& step : assign->steps){
+            words.push_back(temp(step.slot));
+            words.push_back((uint32_t)(step.by < 0 ? -1 : (int)temp(step.by)));
+            words.push_back((uint32_t)step.amount);
+        }
+        return node;
+    }
+    if(auto tempAssign = dynamic_cast<TempAssignStmt*>(s)){
+        uint32_t value = expr(tempAssign->expr);
+        uint32_t node = begin(nodeHeader('t'));
+        words.push_back(temp(tempAssign->slot));
+        child(node, value);
+        return node;
+    }
+    if(auto ifStmt = dynamic_cast<IfStmt*>(s)){
+        uint32_t condition = expr(ifStmt->condition);
+        uint32_t thenStmt = stmt(ifStmt->thenStmt);
+        uint32_t elseStmt = ifStmt->elseStmt ? stmt(ifStmt->elseStmt) : 0;
+        uint32_t node = begin(nodeHeader('f', 0, ifStmt->elseStmt ? 1 : 0));
+        child(node, condition);
+        child(node, thenStmt);
+        if(ifStmt->elseStmt) child(node, elseStmt);
+        else words.push_back(0);
+        return node;
+    }
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(s)){
+        uint32_t condition = expr(whileStmt->condition);
+        uint32_t body = stmt(whileStmt->body);
+        uint32_t node = begin(nodeHeader(dynamic_cast<DoWhileStmt*>(s) ? 'o' : 'w'));
+        child(node, condition);
+        child(node, body);
+        return node;
+    }
+    auto blockStmt = static_cast<BlockStmt*>(s);
+    std::vector<uint32_t> children;
+    for(Stmt* inner : blockStmt->statements){
+        children.push_back(stmt(inner));
+    }
+    uint32_t node = begin(nodeHeader('k'));
+    words.push_back((uint32_t)children.size());
+    for(uint32_t at : children){
+        child(node, at);
+    }
+    return node;
+}
+
+// ---------- checking ----------
+
+enum Category : char { none, expression, statement };
+
+// words taken by the node at p (at least 1), 0 if its kind is unknown
+uint32_t nodeSize(const uint32_t* p, size_t available){
+    switch(kindOf(p)){
+        case 'I': case 'V': case 'T': case 'd': return 2;
+        case 'B': case 'S': case 'i': case 't': case 'w': case 'o': return 3;
+        case '?': case 'f': return 4;
+        case 'a': return 3 + 3 * countOf(p);
+        case 'k': return available < 2 || p[1] > available - 2 ? 0 : 2 + p[1];
+        default: return 0;
+    }
+}
+
+struct Checker {
+    const uint32_t* words;
+    std::vector<char> category;     // of the node starting at each word
+    uint32_t names;
+    uint32_t temps;
+
+    bool child(uint32_t node, uint32_t field, Category expected, uint32_t start){
+        int32_t rel = (int32_t)words[node + field];
+        return rel < 0 && (int64_t)node + rel >= start && category[node + rel] == expected;
+    }
+
+    bool check(uint32_t start, uint32_t end){
+        for(uint32_t p = start; p < end; ){
+            const uint32_t* n = words + p;
+            uint32_t size = nodeSize(n, end - p);
+            if(size == 0 || size > end - p) return false;
+
+            bool ok = true;
+            Category is = islower(kindOf(n)) ? statement : expression;
+            switch(kindOf(n)){
+                case 'V': case 'd': ok = n[1] < names; break;
+                case 'T': ok = n[1] < temps; break;
+                case 'B':
+                    ok = strchr("+-*/ENLG<>n", opOf(n)) && opOf(n) && child(p, 1, expression, start) && child(p, 2, expression, start);
+                    break;
+                case 'S': case 't': ok = n[1] < temps && child(p, 2, expression, start); break;
+                case 'i': ok = n[1] < names && child(p, 2, expression, start); break;
+                case '?': ok = child(p, 1, expression, start) && child(p, 2, expression, start) && child(p, 3, expression, start); break;
+                case 'a':
+                    ok = n[1] < names && child(p, 2, expression, start);
+                    for(uint32_t k = 0; k < countOf(n) && ok; k++){
+                        ok = n[3 + 3 * k] < temps && ((int32_t)n[4 + 3 * k] == -1 || n[4 + 3 * k] < temps);
+                    }
+                    break;
+                case 'f':
+                    ok = child(p, 1, expression, start) && child(p, 2, statement, start)
+                      && (countOf(n) ? child(p, 3, statement, start) : n[3] == 0);
+                    break;
+                case 'w': case 'o': ok = child(p, 1, expression, start) && child(p, 2, statement, start); break;
+                case 'k':
+                    for(uint32_t k = 0; k < n[1] && ok; k++){
+                        ok = child(p, 2 + k, statement, start);
+                    }
+                    break;
+            }
+            if(!ok) return false;
+            category[p] = is;
+            p += size;
+        }
+        return true;
+    }
+};
+
+// ---------- running ----------
+
+struct Runner {
+    const char* base;
+    std::vector<int*> values;       // by name index
+    std::vector<char*> declared;
+    int* temps = nullptr;
+
+    std::string name(uint32_t index) const {
+        const uint32_t* names = (const uint32_t*)base + ((const uint32_t*)base)[2 + namesAtWord];
+        return std::string(base + names[2 * index], names[2 * index + 1]);
+    }
+
+    static const uint32_t* child(const uint32_t* node, int field){
+        return node + (int32_t)node[field];
+    }
+
+    int eval(const uint32_t* n);
+    void exec(const uint32_t* n);
+};
+
+int Runner::eval(const uint32_t* n){
+    switch(kindOf(n)){
+        case 'I': return (int)n[1];
+        case 'V':
+            if(!*declared[n[1]]){
+                throw std::runtime_error("Undefined variable: " + name(n[1]));
+            }
+            return *values[n[1]];
+        case 'B': {
+            int left = eval(child(n, 1));
+            int right = eval(child(n, 2));
+            switch(opOf(n)){
+                case '+': return left+right;
+                case '-': return left-right;
+                case '*': return left*right;
+                case '/':
+                    if(right == 0){
+                        throw std::runtime_error("Division by zero");
+                    }
+                    return left/right;
+                case 'E': return left == right ? 1 : 0;
+                case 'N': return left != right ? 1 : 0;
+                case '<': return left < right ? 1 : 0;
+                case '>': return left > right ? 1 : 0;
+                case 'L': return left <= right ? 1 : 0;
+                case 'G': return left >= right ? 1 : 0;
+                default:  return left - right;     // 'n', negation
+            }
+        }
+        case 'T': return temps[n[1]];
+        case 'S': return temps[n[1]] = eval(child(n, 2));
+        default: {  // '?', see SelectExpr
+            unsigned mask = 0u - (unsigned)(eval(child(n, 1)) != 0);
+            unsigned ifTrue = (unsigned)eval(child(n, 2));
+            unsigned ifFalse = (unsigned)eval(child(n, 3));
+            return (int)((ifTrue & mask) | (ifFalse & ~mask));
+        }
+    }
+}
+
+void Runner::exec(const uint32_t* n){
+    switch(kindOf(n)){
+        case 'd':
+            *values[n[1]] = 0;
+            *declared[n[1]] = 1;
+            return;
+        case 'i': {
+            int value = eval(child(n, 2));
+            *values[n[1]] = value;
+            *declared[n[1]] = 1;
+            return;
+        }
+        case 'a': {
+            if(!*declared[n[1]]){
+                throw std::runtime_error("Cannot assign to undeclated variable: " + name(n[1]));
+            }
+            *values[n[1]] = eval(child(n, 2));
+            for(uint32_t k = 0; k < countOf(n); k++){
+                const uint32_t* step = n + 3 + 3 * k;
+                unsigned by = (int32_t)step[1] < 0 ? step[2] : (unsigned)temps[step[1]];
+                temps[step[0]] = (int)((unsigned)temps[step[0]] + by);
+            }
+            return;
+        }
+        case 't':
+            temps[n[1]] = eval(child(n, 2));
+            return;
+        case 'f':
+            if(eval(child(n, 1)) != 0){
+                exec(child(n, 2));
+            }else if(countOf(n)){
+                exec(child(n, 3));
+            }
+            return;
+        case 'w':
+            while(eval(child(n, 1)) != 0){
+                exec(child(n, 2));
+            }
+            return;
+        case 'o':
+            do{
+                exec(child(n, 2));
+            }while(eval(child(n, 1)) != 0);
+            return;
+        default:    // 'k'
+            for(uint32_t k = 0; k < n[1]; k++){
+                exec(child(n, 2 + k));
+            }
+            return;
+    }
+}
+
+bool fail(const std::string& path, const char* why){
+    fprintf(stderr, "Invalid AST file %s: %s\n", path.c_str(), why);
+    return false;
+}
+
+bool run(const std::string& path, const char* data, size_t size){
+    const uint32_t* words = (const uint32_t*)data;
+    size_t count = size / 4;
+    if(size % 4 != 0 || count < headerWords || memcmp(data, magic, sizeof(magic)) != 0) return fail(path, "not a binary AST");
+    const uint32_t* header = words + sizeof(magic) / 4;
+    if(header[versionWord] != formatVersion || header[byteOrderWord] != byteOrderMark) return fail(path, "written by another version");
+
+    uint32_t nameCount = header[nameCountWord];
+    uint32_t namesAt = header[namesAtWord];
+    uint32_t stmtCount = header[stmtCountWord];
+    uint32_t rootsAt = header[rootsAtWord];
+    if(rootsAt < headerWords || rootsAt > count || stmtCount > count - rootsAt || namesAt != rootsAt + stmtCount
+       || nameCount > (count - namesAt) / 2 || header[tempCountWord] > count){
+        return fail(path, "damaged header");
+    }
+
+    const uint32_t* names = words + namesAt;
+    for(uint32_t k = 0; k < nameCount; k++){
+        if(names[2 * k] > size || names[2 * k + 1] > size - names[2 * k]) return fail(path, "damaged name table");
+    }
+
+    Checker checker{ words, std::vector<char>(rootsAt, none), nameCount, header[tempCountWord] };
+    if(!checker.check(headerWords, rootsAt)) return fail(path, "damaged node");
+    const uint32_t* roots = words + rootsAt;
+    for(uint32_t k = 0; k < stmtCount; k++){
+        if(roots[k] >= rootsAt || checker.category[roots[k]] != statement) return fail(path, "damaged node");
+    }
+
+    // every name gets its slot up front, after that the slots do not move
+    Runner runner{ data };
+    std::vector<int> slots;
+    for(uint32_t k = 0; k < nameCount; k++){
+        slots.push_back(variableSlot(runner.name(k)));
+    }
+    for(int slot : slots){
+        runner.values.push_back(&variableValue(slot));
+        runner.declared.push_back(&variableDeclared(slot));
+    }
+    int first = -1;
+    for(uint32_t k = 0; k < header[tempCountWord]; k++){
+        int slot = newTempSlot();
+        if(first < 0) first = slot;
+    }
+    if(first >= 0) runner.temps = &tempValue(first);
+
+    for(uint32_t k = 0; k < stmtCount; k++){
+        runner.exec(words + roots[k]);
+    }
+    return true;
+}
+
+} // namespace
+
+bool writeAstBinary(const std::string& path, const std::vector<Stmt*>& stmts){
+    Encoder enc;
+    std::vector<uint32_t> roots;
+    for(Stmt* s : stmts){
+        roots.push_back(enc.stmt(s));
+    }
+
+    std::vector<uint32_t>& words = enc.words;
+    uint32_t rootsAt = (uint32_t)words.size();
+    words.insert(words.end(), roots.begin(), roots.end());
+
+    // the characters follow the (offset, length) pairs, padded to whole words
+    uint32_t namesAt = (uint32_t)words.size();
+    size_t text = (namesAt + 2 * enc.names.size()) * 4;
+    std::string characters;
+    for(const std::string& n : enc.names){
+        words.push_back((uint32_t)(text + characters.size()));
+        words.push_back((uint32_t)n.size());
+        characters += n;
+    }
+    characters.resize((characters.size() + 3) / 4 * 4, '\0');
+
+    memcpy(&words[0], magic, sizeof(magic));
+    uint32_t* header = &words[sizeof(magic) / 4];
+    header[versionWord] = formatVersion;
+    header[byteOrderWord] = byteOrderMark;
+    header[nameCountWord] = (uint32_t)enc.names.size();
+    header[namesAtWord] = namesAt;
+    header[tempCountWord] = enc.temps;
+    header[stmtCountWord] = (uint32_t)roots.size();
+    header[rootsAtWord] = rootsAt;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if(!f) return false;
+    bool written = fwrite(words.data(), 4, words.size(), f) == words.size()
+                && fwrite(characters.data(), 1, characters.size(), f) == characters.size();
+    return fclose(f) == 0 && written;
+}
+
+bool runAstBinary(const std::string& path){
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0){
+        if(fd >= 0) close(fd);
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return false;
+    }
+    if(info.st_size == 0){
+        close(fd);
+        return fail(path, "not a binary AST");
+    }
+
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        fprintf(stderr, "Cannot map %s\n", path.c_str());
+        return false;
+    }
+    bool ok = run(path, (const char*)data, info.st_size);
+    munmap(data, info.st_size);
+    return ok;
+}
@@ -0,0 +1,204 @@
+// merkle hashing of the ast.
+// every node is hashed from a tag for its kind, its own data (operator, literal, name,
+// temporary slot) and the already computed hashes of its children, so a subtree's hash
+// only has to be computed once, bottom-up, while the parser builds it:
+//
+//   x + 1      hash('B', '+', hash(VarExpr x), hash(IntExpr 1))
+//
+// what the optimizer attaches and changes how a node runs (the steps of an assignment, a
+// closed form, lowered arithmetic) is hashed too, after the children, and only when it is
+// there, so trees as parsed hash the same with or without it. the facts of the analyses
+// (value ranges, provenDeclared) are left out: they only drop checks that can not fail.
+//
+// the hash has two independent 64 bit lanes, each fed every word and finished with the
+// murmur3 mixer. it only depends on the structure, never on addresses, so it is stable
+// between runs and can key caches that outlive the process.
+
+#include "ast.hpp"
+#include<cstdio>
+
+namespace {
+
+uint64_t mix(uint64_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+struct Hasher {
+    uint64_t a = 0x9e3779b97f4a7c15ULL;
+    uint64_t b = 0x6a09e667f3bcc908ULL;
+    uint64_t words = 0;
+
+    void add(uint64_t v){
+        a = mix(a ^ v) + 0x165667b19e3779f9ULL;
+        b = mix(b + v * 0x87c37b91114253d5ULL) ^ (b >> 29);
+        words++;
+    }
+
+    void add(const Hash128& h){
+        add(h.hi);
+        add(h.lo);
+    }
+
+    void add(const char* text, size_t size){
+        add((uint64_t)size);
+        for(size_t i = 0; i < size; i += 8){
+            uint64_t word = 0;
+            for(size_t k = i; k < size && k < i + 8; k++){
+                word = word << 8 | (unsigned char)text[k];
+            }
+            add(word);
+        }
+    }
+
+    void add(const std::string& text){
+        add(text.data(), text.size());
+    }
+
+    void add(const std::vector<std::string>& names){
+        add((uint64_t)names.size());
+        for(const std::string& name : names) add(name);
+    }
+
+    Hash128 finish(){
+        Hash128 h;
+        h.hi = mix(a ^ words);
+        h.lo = mix(b ^ (words << 32) ^ a);
+        return h;
+    }
+};
+
+void hashChild(Hasher& h, ASTNode* child, bool rehash){
+    if(!child){
+        h.add((uint64_t)0);
+        return;
+    }
+    h.add(rehash ? rehashTree(child) : child->hash);
+}
+
+// hash of node from its children, which are hashed first when rehash is set
+Hash128 compute(ASTNode* node, bool rehash){
+    Hasher h;
+    if(auto intExpr = dynamic_cast<IntExpr*>(node)){
+        h.add('I');
+        h.add((uint64_t)(uint32_t)intExpr->value);
+    }else if(auto varExpr = dynamic_cast<VarExpr*>(node)){
+        h.add('V');
+        h.add(varExpr->name);
+    }else if(auto binExpr = dynamic_cast<BinaryExpr*>(node)){
+        h.add('B');
+        h.add((uint64_t)(unsigned char)binExpr->op);
+        hashChild(h, binExpr->left, rehash);
+        hashChild(h, binExpr->right, rehash);
+        const ConstArith& lowered = binExpr->lowered;
+        if(lowered.kind){
+            h.add((uint64_t)(unsigned char)lowered.kind);
+            h.add((uint64_t)(uint32_t)lowered.shiftA);
+            h.add((uint64_t)(uint32_t)lowered.shiftB);
+            h.add((uint64_t)(uint32_t)lowered.magic);
+        }
+    }else if(auto tempExpr = dynamic_cast<TempExpr*>(node)){
+        h.add('T');
+        h.add((uint64_t)tempExpr->slot);
+    }else if(auto tempStore = dynamic_cast<TempStoreExpr*>(node)){
+        h.add('S');
+        h.add((uint64_t)tempStore->slot);
+        hashChild(h, tempStore->expr, rehash);
+    }else if(auto select = dynamic_cast<SelectExpr*>(node)){
+        h.add('?');
+        hashChild(h, select->condition, rehash);
+        hashChild(h, select->ifTrue, rehash);
+        hashChild(h, select->ifFalse, rehash);
+    }else if(auto decl = dynamic_cast<VarDeclStmt*>(node)){
+        h.add('d');
+        h.add(decl->name);
+    }else if(auto declInit = dynamic_cast<VarDeclInitStmt*>(node)){
+        h.add('i');
+        h.add(declInit->name);
+        hashChild(h, declInit->expr, rehash);
+    }else if(auto assign = dynamic_cast<AssignStmt*>(node)){
+        h.add('a');
+        h.add(assign->name);
+        hashChild(h, assign->expr, rehash);
+        for(const TempStep& step : assign->steps){
+            h.add((uint64_t)(uint32_t)step.slot);
+            h.add((uint64_t)(uint32_t)step.by);
+            h.add((uint64_t)(uint32_t)step.amount);
+        }
+    }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(node)){
+        h.add('t');
+        h.add((uint64_t)tempAssign->slot);
+        hashChild(h, tempAssign->expr, rehash);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(node)){
+        h.add('f');
+        hashChild(h, ifStmt->condition, rehash);
+        hashChild(h, ifStmt->thenStmt, rehash);
+        hashChild(h, ifStmt->elseStmt, rehash);
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(node)){
+        // the optimizer's loop forms run differently and must not collide with a while
+        char tag = 'w';
+        if(dynamic_cast<ClosedFormWhileStmt*>(node)) tag = 'c';
+        if(dynamic_cast<DoWhileStmt*>(node)) tag = 'o';
+        h.add(tag);
+        hashChild(h, whileStmt->condition, rehash);
+        hashChild(h, whileStmt->body, rehash);
+        if(auto closedForm = dynamic_cast<ClosedFormWhileStmt*>(node)){
+            h.add(closedForm->counter);
+            h.add((uint64_t)closedForm->counterOnLeft);
+            h.add((uint64_t)(unsigned char)closedForm->cmp);
+            h.add(closedForm->inductions);
+            for(int step : closedForm->steps) h.add((uint64_t)(uint32_t)step);
+            h.add(closedForm->accumulators);
+            h.add(closedForm->derived);
+            h.add((uint64_t)closedForm->degree);
+        }
+    }else if(auto blockStmt = dynamic_cast<BlockStmt*>(node)){
+        h.add('k');
+        h.add((uint64_t)blockStmt->statements.size());
+        for(Stmt* s : blockStmt->statements){
+            hashChild(h, s, rehash);
+        }
+    }else if(auto lazy = dynamic_cast<LazyBlockStmt*>(node)){
+        // its text; the statements in it are not known
+        h.add('z');
+        h.add(lazy->begin, lazy->end - lazy->begin);
+    }
+    return h.finish();
+}
+
+} // namespace
+
+std::string Hash128::hex() const {
+    char text[33];
+    snprintf(text, sizeof(text), "%016llx%016llx", (unsigned long long)hi, (unsigned long long)lo);
+    return text;
+}
+
+void hashNode(ASTNode* node){
+    node->hash = compute(node, false);
+}
+
+Hash128 rehashTree(ASTNode* node){
+    return node->hash = compute(node, true);
+}
+
+Hash128 programHash(const std::vector<Stmt*>& stmts){
+    Hasher h;
+    h.add('P');
+    h.add((uint64_t)stmts.size());
+    for(Stmt* s : stmts){
+        h.add(s->hash);
+    }
+    return h.finish();
+}
+
+Hash128 hashBytes(const char* bytes, size_t size){
+    Hasher h;
+    h.add('R');
+    h.add(bytes, size);
+    return h.finish();
+}
@@ -0,0 +1,161 @@
+// bytecode for --single-pass (see bytecode.hpp).
+// bison reduces the operands of an expression before the operator, so emitting at each
+// reduction gives postfix code for a stack machine. statements need their jumps in front of
+// code that is not parsed yet; the grammar has empty rules (jump_if_false, jump, label) that
+// reduce at those points, emit the jump with a placeholder and hand its position up as the
+// rule's value, and the enclosing rule patches it once it is reduced:
+//
+//   while (i < 3) i = i + 1;       0: load i  2: push 3  4: lt  5: jump_if_false 18
+//                                  7: check_assign i  9: load i  11: push 1  13: add
+//                                  14: store i  16: jump 0  18: the next statement
+//
+// the checks and the order of evaluation are the ones of execStmt() and evalExpr(), so a
+// program prints the same symbol table and dies with the same runtime error. what the tree
+// allows and this does not: printing the program, its hash, the optimizer and the warnings
+// of opt_declared.cpp.
+
+#include "bytecode.hpp"
+#include "ast.hpp"
+#include<iostream>
+#include<stdexcept>
+
+namespace {
+
+// how many values an opcode leaves on the stack, minus the ones it takes
+int stackEffect(Op op){
+    switch(op){
+        case OpPush: case OpLoad: return 1;
+        case OpCheckAssign: case OpDeclare: case OpJump: case OpNegate: return 0;
+        default: return -1;
+    }
+}
+
+} // namespace
+
+void emit(Bytecode& code, Op op){
+    code.words.push_back(op);
+    code.depth += stackEffect(op);
+    if(code.depth > code.maxDepth) code.maxDepth = code.depth;
+}
+
+void emit(Bytecode& code, Op op, int operand){
+    emit(code, op);
+    code.words.push_back(operand);
+}
+
+void emitVariable(Bytecode& code, Op op, const char* name){
+    int slot = variableSlot(name);
+    if(slot >= (int)code.names.size()) code.names.resize(slot + 1);
+    if(code.names[slot].empty()) code.names[slot] = name;
+    emit(code, op, slot);
+}
+
+void emitOperator(Bytecode& code, char op){
+    switch(op){
+        case '+': emit(code, OpAdd); break;
+        case '-': emit(code, OpSub); break;
+        case '*': emit(code, OpMul); break;
+        case '/': emit(code, OpDiv); break;
+        case 'E': emit(code, OpEq); break;
+        case 'N': emit(code, OpNe); break;
+        case '<': emit(code, OpLt); break;
+        case '>': emit(code, OpGt); break;
+        case 'L': emit(code, OpLe); break;
+        case 'G': emit(code, OpGe); break;
+        default: throw std::runtime_error("Unknown Binary operation");
+    }
+}
+
+int emitJump(Bytecode& code, Op op){
+    emit(code, op, -1);
+    return here(code) - 1;
+}
+
+void patchJump(Bytecode& code, int at, int target){
+    code.words[at] = target;
+}
+
+void runBytecode(const Bytecode& code){
+    std::vector<int> stack(code.maxDepth + 1);
+    int* top = stack.data();        // one past the top value
+    const int* start = code.words.data();
+    const int* pc = start;
+    const int* end = start + code.words.size();
+    while(pc < end){
+        int op = *pc++;
+        switch(op){
+            case OpPush:
+                *top++ = *pc++;
+                break;
+            case OpLoad: {
+                int slot = *pc++;
+                if(!variableDeclared(slot)){
+                    throw std::runtime_error("Undefined variable: " + code.names[slot]);
+                }
+                *top++ = variableValue(slot);
+                break;
+            }
+            case OpCheckAssign: {
+                int slot = *pc++;
+                if(!variableDeclared(slot)){
+                    throw std::runtime_error("Cannot assign to undeclated variable: " + code.names[slot]);
+                }
+                break;
+            }
+            case OpStore:
+                variableValue(*pc++) = *--top;
+                break;
+            case OpDeclare: {
+                int slot = *pc++;
+                variableValue(slot) = 0;
+                variableDeclared(slot) = 1;
+                break;
+            }
+            case OpDeclareStore: {
+                int slot = *pc++;
+                variableValue(slot) = *--top;
+                variableDeclared(slot) = 1;
+                break;
+            }
+            case OpJumpIfFalse:
+                pc = *--top == 0 ? start + *pc : pc + 1;
+                break;
+            case OpJump:
+                pc = start + *pc;
+                break;
+            case OpNegate:
+                top[-1] = 0 - top[-1];
+                break;
+            default: {
+                int right = *--top;
+                int left = top[-1];
+                switch(op){
+                    case OpAdd: left = left + right; break;
+                    case OpSub: left = left - right; break;
+                    case OpMul: left = left * right; break;
+                    case OpDiv:
+                        if(right == 0){
+                            throw std::runtime_error("Division by zero");
+                        }
+                        left = left / right;
+                        break;
+                    case OpEq: left = left == right ? 1 : 0; break;
+                    case OpNe: left = left != right ? 1 : 0; break;
+                    case OpLt: left = left < right ? 1 : 0; break;
+                    case OpGt: left = left > right ? 1 : 0; break;
+                    case OpLe: left = left <= right ? 1 : 0; break;
+                    case OpGe: left = left >= right ? 1 : 0; break;
+                    default: throw std::runtime_error("Unknown opcode");
+                }
+                top[-1] = left;
+                break;
+            }
+        }
+    }
+}
+
+void printBytecodeStats(const Bytecode& code){
+    std::cout<<"\n---- Bytecode ----\n";
+    std::cout<<"code: "<<code.words.size()<<" words, "<<code.words.size() * sizeof(int)<<" bytes\n";
+    std::cout<<"stack depth: "<<code.maxDepth<<"\n";
+}
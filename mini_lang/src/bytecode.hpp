@@ -0,0 +1,50 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+// single-pass compilation (bytecode.cpp). with --single-pass the grammar actions in parser.y
+// emit stack machine code as they reduce instead of building nodes, and the code runs once
+// parsing is done. no tree is ever allocated: the code grows with the program text and the
+// parser stack with the nesting depth.
+
+#include<string>
+#include<vector>
+
+// every opcode is one word, the ones up to OpJump are followed by an operand word
+enum Op {
+    OpPush,             // literal
+    OpLoad,             // slot; throws if the variable is not declared
+    OpCheckAssign,      // slot; throws if the variable is not declared
+    OpStore,            // slot
+    OpDeclare,          // slot, value 0
+    OpDeclareStore,     // slot
+    OpJumpIfFalse,      // target word
+    OpJump,             // target word
+    OpAdd, OpSub, OpMul, OpDiv,
+    OpEq, OpNe, OpLt, OpGt, OpLe, OpGe,
+    OpNegate,
+};
+
+struct Bytecode {
+    std::vector<int> words;
+    std::vector<std::string> names; // variable names by slot, for the error messages
+    int depth = 0;                  // values on the stack after the last word
+    int maxDepth = 0;
+    size_t complete = 0;            // end of the last whole top-level statement
+};
+
+void emit(Bytecode& code, Op op);
+void emit(Bytecode& code, Op op, int operand);
+void emitVariable(Bytecode& code, Op op, const char* name);     // looks up the slot
+void emitOperator(Bytecode& code, char op);    // a BinaryExpr operator: '+', 'E', 'L', ...
+
+// jumps are emitted before their target is known: emitJump returns the operand word and
+// patchJump fills it in later
+int emitJump(Bytecode& code, Op op);
+void patchJump(Bytecode& code, int at, int target);
+inline int here(const Bytecode& code){ return (int)code.words.size(); }
+
+// runs the code on the symbol table in ast.cpp; runtime errors throw like execStmt()
+void runBytecode(const Bytecode& code);
+void printBytecodeStats(const Bytecode& code);  // --stats
+
+#endif
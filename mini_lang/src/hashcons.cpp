@@ -0,0 +1,123 @@
+// expression construction for the parser, with optional hash-consing.
+// with hash-consing enabled every expression node is looked up in a table before it is
+// allocated. the children of a new node are already canonical, so two expressions are
+// structurally equal exactly when their kind, value / name / operator and child pointers
+// are, and a table keyed on those finds the existing node:
+//
+//   a = (x + 1) * (x + 1);      one IntExpr(1), one VarExpr("x"), one BinaryExpr(+) used
+//   b = x + 1;                  twice by the MUL and once more by b
+//
+// interned nodes are owned by the table, not by their parents (see releaseExpr in ast.hpp).
+// the optimizer rewrites nodes in place, so main() gives it a private copy of the program
+// and drops the shared nodes before it runs; only --no-opt executes the DAG itself.
+
+#include "ast.hpp"
+#include<functional>
+#include<iostream>
+#include<unordered_map>
+
+namespace {
+
+bool enabled = false;
+
+struct BinaryKey {
+    char op;
+    Expr* left;
+    Expr* right;
+
+    bool operator==(const BinaryKey& o) const {
+        return op == o.op && left == o.left && right == o.right;
+    }
+};
+
+struct BinaryKeyHash {
+    size_t operator()(const BinaryKey& k) const {
+        size_t h = std::hash<Expr*>()(k.left);
+        h = h * 31 + std::hash<Expr*>()(k.right);
+        return h * 31 + (unsigned char)k.op;
+    }
+};
+
+std::unordered_map<int, IntExpr*> ints;
+std::unordered_map<std::string, VarExpr*> vars;
+std::unordered_map<BinaryKey, BinaryExpr*, BinaryKeyHash> binaries;
+
+// what the parser asked for and what it got, for --stats. only counted with hash-consing on,
+// without it several parsers may be building nodes at once (specparse.cpp)
+long long nodesParsed = 0;
+long long bytesParsed = 0;
+long long nodesKept = 0;
+long long bytesKept = 0;
+
+void count(size_t size, bool created){
+    nodesParsed++;
+    bytesParsed += size;
+    if(created){
+        nodesKept++;
+        bytesKept += size;
+    }
+}
+
+} // namespace
+
+void enableHashConsing(){
+    enabled = true;
+}
+
+bool hashConsingEnabled(){
+    return enabled;
+}
+
+Expr* makeIntExpr(int value){
+    if(!enabled) return hashed(new IntExpr(value));
+    IntExpr*& node = ints[value];
+    count(sizeof(IntExpr), !node);
+    if(!node){
+        node = hashed(new IntExpr(value));
+        node->interned = true;
+    }
+    return node;
+}
+
+Expr* makeVarExpr(const std::string& name){
+    if(!enabled) return hashed(new VarExpr(name));
+    VarExpr*& node = vars[name];
+    count(sizeof(VarExpr), !node);
+    if(!node){
+        node = hashed(new VarExpr(name));
+        node->interned = true;
+    }
+    return node;
+}
+
+Expr* makeBinaryExpr(char op, Expr* left, Expr* right){
+    if(!enabled) return hashed(new BinaryExpr(op, left, right));
+    BinaryExpr*& node = binaries[BinaryKey{op, left, right}];
+    count(sizeof(BinaryExpr), !node);
+    if(!node){
+        node = hashed(new BinaryExpr(op, left, right));
+        node->interned = true;
+    }
+    return node;
+}
+
+void releaseInterned(){
+    // the children of an interned node are interned too and may already be gone, so they are
+    // detached first and every node is deleted exactly once by this loop
+    for(auto& entry : binaries){
+        entry.second->left = nullptr;
+        entry.second->right = nullptr;
+        delete entry.second;
+    }
+    for(auto& entry : vars) delete entry.second;
+    for(auto& entry : ints) delete entry.second;
+    binaries.clear();
+    vars.clear();
+    ints.clear();
+}
+
+void printHashConsStats(){
+    std::cout<<"\n---- Hash Consing ----\n";
+    std::cout<<"expression nodes: "<<nodesParsed<<" parsed, "<<nodesKept<<" kept\n";
+    std::cout<<"expression memory: "<<bytesParsed<<" bytes as trees, "<<bytesKept<<" bytes shared\n";
+}
@@ -0,0 +1,73 @@
+// lazy parsing of blocks (see lazyblock.hpp).
+// the first pass only needs to know where a block ends. no token inside a block contains a
+// brace and only a comment can hide one, so counting braces byte by byte and skipping '//'
+// to the end of the line finds the same '}' the parser would. that is a plain loop over
+// the text, with no tokens, no parser and no nodes.
+//
+// the text between the braces stays where it is in the source, which lives until the
+// program is done. parsing it later is parsing a program of its own: a statement list,
+// with the blocks in it lazy again. what is not parsed is not checked either. a syntax
+// error or an unknown character inside a block only shows up when the block runs, and
+// then the syntax error stops the program like a runtime error.
+
+#include "lazyblock.hpp"
+#include "parser.tab.hpp"
+#include<cstring>
+#include<iostream>
+#include<stdexcept>
+
+namespace {
+
+int (*blockParser)(ParseContext&) = nullptr;
+long blocksMatched = 0;
+long blocksParsed = 0;
+
+BlockStmt* parseBlock(LazyBlockStmt* lazy){
+    // the byte at end is the '}', the source is padded after it
+    Scanner scanner = { lazy->begin, lazy->end };
+    std::vector<Stmt*> statements;
+    ParseContext context;
+    context.statements = &statements;
+    context.source = &scanner;
+    if(blockParser(context) != 0){
+        for(Stmt* s : statements) delete s;
+        throw std::runtime_error("Syntax error in a block");
+    }
+    blocksParsed++;
+    return hashed(new BlockStmt(statements));
+}
+
+} // namespace
+
+bool matchBlock(Scanner& s, const char*& begin, const char*& end){
+    int depth = 1;
+    for(const char* p = s.p; p < s.end; p++){
+        if(*p == '{'){
+            depth++;
+        }else if(*p == '}'){
+            if(--depth == 0){
+                begin = s.p;
+                end = p;
+                s.p = p + 1;
+                blocksMatched++;
+                return true;
+            }
+        }else if(*p == '/' && p + 1 < s.end && p[1] == '/'){
+            const char* newline = (const char*)memchr(p, '\n', s.end - p);
+            if(!newline) return false;
+            p = newline;
+        }
+    }
+    return false;
+}
+
+void enableLazyBlocks(int (*parse)(ParseContext&)){
+    blockParser = parse;
+    parseLazyBlock = parseBlock;
+}
+
+void printLazyBlockStats(){
+    std::cout<<"\n---- Lazy Blocks ----\n";
+    std::cout<<"blocks matched: "<<blocksMatched<<"\n";
+    std::cout<<"blocks parsed: "<<blocksParsed<<"\n";
+}
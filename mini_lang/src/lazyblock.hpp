@@ -0,0 +1,22 @@
+#ifndef LAZYBLOCK_HPP
+#define LAZYBLOCK_HPP
+
+// lazy parsing of blocks (lazyblock.cpp). with --lazy-blocks the parser reads the source
+// through a Scanner in its ParseContext, and a '{' does not start the statements of a block:
+// the text up to the matching '}' is skipped and the parser gets a single LAZYBLOCK token
+// with a LazyBlockStmt for it (ast.hpp). the block is parsed the first time it runs, so a
+// branch that is never taken is never parsed and its nodes never allocated.
+
+#include "specparse.hpp"
+
+// s.p is just past a '{': finds the matching '}' and moves s.p past it, begin / end are the
+// text in between. braces in comments do not count, as the scanner skips those. false, and
+// s untouched, if the '{' is never closed; the parser then reports the error as usual
+bool matchBlock(Scanner& s, const char*& begin, const char*& end);
+
+// lazy blocks are parsed with parse (yyparse or prattParse) from now on
+void enableLazyBlocks(int (*parse)(ParseContext&));
+
+void printLazyBlockStats();     // --stats: blocks matched and blocks parsed
+
+#endif
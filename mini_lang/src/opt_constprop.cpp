@@ -0,0 +1,316 @@
+// sparse conditional constant propagation.
+// we walk the statement tree with an abstract symbol table that tracks, for every variable,
+// whether it is declared and whether its value is a known constant. while walking we
+//   - replace reads of known constants with literals and fold the resulting expressions
+//   - replace an if statement whose condition became constant with the branch that runs
+//   - drop while loops whose condition is already false on entry
+// branches that can not run never contribute to the state after them, which is what makes
+// the propagation "conditional": var debug = 0; if (debug) x = 1; keeps x constant.
+
+#include "optimize.hpp"
+#include<map>
+#include<string>
+
+namespace {
+
+enum class Decl { No, Maybe, Yes };        // is the variable in the symbol table?
+enum class Val { Bottom, Const, Top };     // bottom: no value seen yet, top: not a constant
+
+struct VarInfo {
+    Decl decl = Decl::No;
+    Val kind = Val::Bottom;
+    int value = 0;
+
+    bool operator==(const VarInfo& o) const {
+        return decl == o.decl && kind == o.kind && (kind != Val::Const || value == o.value);
+    }
+};
+
+// abstract symbol table at one point of the program
+struct State {
+    bool reachable = true;
+    bool opaque = false;                   // passed a statement we could not analyse
+    std::map<std::string, VarInfo> vars;   // missing entry = never declared (unless opaque)
+
+    bool operator==(const State& o) const {
+        return reachable == o.reachable && opaque == o.opaque && vars == o.vars;
+    }
+};
+
+// result of evaluating an expression on the abstract state
+struct AbsVal {
+    bool isConst = false;
+    int value = 0;
+    bool safe = true;       // can not throw
+    bool mustFail = false;  // always throws
+};
+
+VarInfo lookup(const State& st, const std::string& name){
+    auto it = st.vars.find(name);
+    if(it != st.vars.end()) return it->second;
+
+    VarInfo info;
+    if(st.opaque){
+        info.decl = Decl::Maybe;
+        info.kind = Val::Top;
+    }
+    return info;
+}
+
+Decl joinDecl(Decl a, Decl b){
+    return a == b ? a : Decl::Maybe;
+}
+
+VarInfo joinVar(const VarInfo& a, const VarInfo& b){
+    VarInfo r;
+    r.decl = joinDecl(a.decl, b.decl);
+    if(a.kind == Val::Bottom){
+        r.kind = b.kind;
+        r.value = b.value;
+    }else if(b.kind == Val::Bottom){
+        r.kind = a.kind;
+        r.value = a.value;
+    }else if(a.kind == Val::Const && b.kind == Val::Const && a.value == b.value){
+        r.kind = Val::Const;
+        r.value = a.value;
+    }else{
+        r.kind = Val::Top;
+    }
+    return r;
+}
+
+State join(const State& a, const State& b){
+    if(!a.reachable) return b;
+    if(!b.reachable) return a;
+
+    State r;
+    r.opaque = a.opaque || b.opaque;
+    for(const auto& entry : a.vars){
+        r.vars[entry.first] = joinVar(entry.second, lookup(b, entry.first));
+    }
+    for(const auto& entry : b.vars){
+        if(!r.vars.count(entry.first)){
+            r.vars[entry.first] = joinVar(lookup(a, entry.first), entry.second);
+        }
+    }
+    return r;
+}
+
+AbsVal evalAbstract(Expr* expr, const State& st){
+    AbsVal r;
+    if(auto intExpr = dynamic_cast<IntExpr*>(expr)){
+        r.isConst = true;
+        r.value = intExpr->value;
+        return r;
+    }
+
+    if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+        VarInfo info = lookup(st, varExpr->name);
+        if(info.decl == Decl::Yes){
+            r.isConst = info.kind == Val::Const;
+            r.value = info.value;
+        }else{
+            r.safe = false;
+            r.mustFail = info.decl == Decl::No;
+        }
+        return r;
+    }
+
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        AbsVal left = evalAbstract(binExpr->left, st);
+        AbsVal right = evalAbstract(binExpr->right, st);
+        r.safe = left.safe && right.safe;
+        r.mustFail = left.mustFail || right.mustFail;
+        if(binExpr->op == '/' && right.isConst && right.value == 0){
+            r.safe = false;
+            r.mustFail = true;
+        }
+        if(r.safe && left.isConst && right.isConst){
+            r.isConst = foldBinary(binExpr->op, left.value, right.value, r.value);
+            if(!r.isConst) r.safe = false;   // INT_MIN / -1 traps at runtime
+        }else if(binExpr->op == '/' && !right.isConst){
+            r.safe = false;
+        }
+        return r;
+    }
+
+    r.safe = false;
+    return r;
+}
+
+// rewrite an expression using the facts in st, returns the (possibly new) expression
+Expr* foldExpr(Expr* expr, const State& st){
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        binExpr->left = foldExpr(binExpr->left, st);
+        binExpr->right = foldExpr(binExpr->right, st);
+    }
+    if(dynamic_cast<IntExpr*>(expr)) return expr;
+
+    AbsVal v = evalAbstract(expr, st);
+    if(v.isConst && v.safe){
+        optStats.constantsFolded++;
+        delete expr;
+        return new IntExpr(v.value);
+    }
+    return expr;
+}
+
+void assignVar(State& st, const std::string& name, const AbsVal& v){
+    VarInfo& info = st.vars[name];
+    info.decl = Decl::Yes;
+    info.kind = v.isConst ? Val::Const : Val::Top;
+    info.value = v.value;
+}
+
+// give up on constants for everything (used when a loop does not settle quickly)
+void widen(State& st){
+    for(auto& entry : st.vars){
+        entry.second.kind = Val::Top;
+    }
+}
+
+// walk one statement, updating st. when rewrite is set the statement is also simplified
+// and the returned pointer replaces it (nullptr = statement removed).
+Stmt* visit(Stmt* stmt, State& st, bool rewrite);
+
+void visitList(std::vector<Stmt*>& stmts, State& st, bool rewrite){
+    size_t out = 0;
+    for(size_t i = 0; i < stmts.size(); i++){
+        Stmt* s = visit(stmts[i], st, rewrite);
+        if(s) stmts[out++] = s;
+    }
+    stmts.resize(out);
+}
+
+// a removed branch of an if/while still needs a statement in its place
+Stmt* orEmpty(Stmt* stmt){
+    return stmt ? stmt : new BlockStmt({});
+}
+
+Stmt* visit(Stmt* stmt, State& st, bool rewrite){
+    if(!st.reachable) return stmt;
+
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+        AbsVal zero;
+        zero.isConst = true;
+        assignVar(st, decl->name, zero);
+        return stmt;
+    }
+
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        AbsVal v = evalAbstract(declInit->expr, st);
+        if(rewrite) declInit->expr = foldExpr(declInit->expr, st);
+        if(v.mustFail){
+            st.reachable = false;
+        }else{
+            assignVar(st, declInit->name, v);
+        }
+        return stmt;
+    }
+
+    if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        Decl target = lookup(st, assign->name).decl;
+        AbsVal v = evalAbstract(assign->expr, st);
+        if(rewrite) assign->expr = foldExpr(assign->expr, st);
+        if(target == Decl::No || v.mustFail){
+            st.reachable = false;
+        }else{
+            assignVar(st, assign->name, v);
+        }
+        return stmt;
+    }
+
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        AbsVal cond = evalAbstract(ifStmt->condition, st);
+        if(cond.mustFail){
+            st.reachable = false;
+            return stmt;
+        }
+
+        if(cond.isConst && cond.safe){
+            Stmt*& taken = cond.value != 0 ? ifStmt->thenStmt : ifStmt->elseStmt;
+            Stmt* result = taken ? visit(taken, st, rewrite) : nullptr;
+            if(!rewrite) return stmt;
+
+            // detach the branch we keep, the rest goes away with the if
+            taken = nullptr;
+            delete ifStmt;
+            optStats.branchesRemoved++;
+            return result;
+        }
+
+        if(rewrite) ifStmt->condition = foldExpr(ifStmt->condition, st);
+        State elseState = st;
+        Stmt* thenS = visit(ifStmt->thenStmt, st, rewrite);
+        Stmt* elseS = ifStmt->elseStmt ? visit(ifStmt->elseStmt, elseState, rewrite) : nullptr;
+        if(rewrite){
+            ifStmt->thenStmt = orEmpty(thenS);
+            ifStmt->elseStmt = elseS;
+        }
+        st = join(st, elseState);
+        return stmt;
+    }
+
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        // find the state at the loop head: start from the entry state and keep adding
+        // whatever the body produces until nothing changes
+        State head = st;
+        AbsVal cond;
+        for(int iteration = 0; ; iteration++){
+            cond = evalAbstract(whileStmt->condition, head);
+            if(cond.mustFail || (cond.isConst && cond.safe && cond.value == 0)) break;
+
+            State bodyState = head;
+            visit(whileStmt->body, bodyState, false);
+            State next = join(st, bodyState);
+            if(iteration > 32) widen(next);
+            if(next == head) break;
+            head = next;
+        }
+
+        if(cond.mustFail){
+            st = head;
+            st.reachable = false;
+            return stmt;
+        }
+
+        if(cond.isConst && cond.safe && cond.value == 0){
+            st = head;
+            if(!rewrite) return stmt;
+            // never entered (the head state is the entry state in this case)
+            delete whileStmt;
+            optStats.loopsRemoved++;
+            return nullptr;
+        }
+
+        if(rewrite){
+            whileStmt->condition = foldExpr(whileStmt->condition, head);
+            State bodyState = head;
+            whileStmt->body = orEmpty(visit(whileStmt->body, bodyState, true));
+        }
+
+        st = head;
+        if(cond.isConst && cond.safe) st.reachable = false;   // while(1) only ends by an error
+        return stmt;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        visitList(blockStmt->statements, st, rewrite);
+        return stmt;
+    }
+
+    // unknown statement: forget everything we know
+    widen(st);
+    for(auto& entry : st.vars){
+        entry.second.decl = joinDecl(entry.second.decl, Decl::No);
+    }
+    st.opaque = true;
+    return stmt;
+}
+
+} // namespace
+
+void propagateConstants(std::vector<Stmt*>& stmts){
+    State st;
+    visitList(stmts, st, true);
+}
@@ -0,0 +1,185 @@
+// local value numbering.
+// every value computed in a straight run of statements gets a number: a variable read gets
+// the number of the last write to it, a literal the number of its value, and a binary
+// expression the number belonging to (op, left number, right number). when a binary
+// expression's number was already computed earlier in the run, the earlier occurrence saves
+// its result in a temporary and the later one just reads it:
+//
+//   x = (a + b) * (a + b);     ->    x = (t0 := a + b) * t0;
+//   y = (a + b) - c;           ->    y = t0 - c;
+//
+// assigning a variable gives it a new number, so expressions that read the old value no
+// longer match. expressions have no side effects other than throwing, and the first
+// occurrence is always evaluated before the later ones, so reusing its result can not
+// change which error (if any) is raised.
+// a run ends at an if or while statement: the condition still belongs to it (it is
+// evaluated unconditionally), the branches and loop body start with what was known before.
+
+#include "optimize.hpp"
+#include<map>
+#include<tuple>
+
+namespace {
+
+struct ValueNumbering {
+    struct Available {
+        Expr** where;   // first occurrence
+        int slot;       // temporary holding its value, -1 until it is reused
+    };
+
+    int next = 0;
+    std::map<std::string, int> vars;
+    std::map<int, int> temps;
+    std::map<int, int> literals;
+    std::map<std::tuple<char, int, int>, int> numbers;     // (op, left, right) -> number
+    std::map<int, Available> available;                    // number -> occurrence
+
+    int numberOf(Expr* expr){
+        if(auto intExpr = dynamic_cast<IntExpr*>(expr)){
+            auto it = literals.find(intExpr->value);
+            return it != literals.end() ? it->second : literals[intExpr->value] = next++;
+        }
+        if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+            auto it = vars.find(varExpr->name);
+            return it != vars.end() ? it->second : vars[varExpr->name] = next++;
+        }
+        if(auto tempExpr = dynamic_cast<TempExpr*>(expr)){
+            auto it = temps.find(tempExpr->slot);
+            return it != temps.end() ? it->second : temps[tempExpr->slot] = next++;
+        }
+        if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+            return temps[tempStore->slot] = numberOf(tempStore->expr);
+        }
+        if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+            auto key = keyOf(binExpr);
+            auto it = numbers.find(key);
+            return it != numbers.end() ? it->second : numbers[key] = next++;
+        }
+        return next++;
+    }
+
+    std::tuple<char, int, int> keyOf(BinaryExpr* binExpr){
+        int l = numberOf(binExpr->left);
+        int r = numberOf(binExpr->right);
+        bool commutative = binExpr->op == '+' || binExpr->op == '*' || binExpr->op == 'E' || binExpr->op == 'N';
+        if(commutative && r < l) std::swap(l, r);
+        return std::make_tuple(binExpr->op, l, r);
+    }
+
+    // rewrites the expression stored at *where, in evaluation order
+    void rewrite(Expr** where){
+        auto binExpr = dynamic_cast<BinaryExpr*>(*where);
+        if(!binExpr){
+            if(auto tempStore = dynamic_cast<TempStoreExpr*>(*where)){
+                rewrite(&tempStore->expr);
+                numberOf(tempStore);
+            }
+            return;
+        }
+
+        int number = numberOf(binExpr);
+        auto it = available.find(number);
+        if(it != available.end()){
+            Available& first = it->second;
+            if(first.slot < 0){
+                // the other branch of an if may already have saved it
+                if(auto saved = dynamic_cast<TempStoreExpr*>(*first.where)){
+                    first.slot = saved->slot;
+                }else{
+                    first.slot = newTempSlot();
+                    *first.where = new TempStoreExpr(first.slot, *first.where);
+                }
+                temps[first.slot] = number;
+            }
+            delete binExpr;
+            *where = new TempExpr(first.slot);
+            optStats.evaluationsEliminated++;
+            return;
+        }
+
+        rewrite(&binExpr->left);
+        rewrite(&binExpr->right);
+        available[number] = Available{where, -1};
+    }
+
+    void assigned(const std::string& name){
+        vars[name] = next++;
+    }
+
+    // forget everything known about the current values, used where control flow merges.
+    // numbers handed out so far are never reused, so nothing afterwards can match them
+    void clear(){
+        vars.clear();
+        temps.clear();
+        available.clear();
+    }
+};
+
+void visit(Stmt* stmt, ValueNumbering& vn);
+
+void visitList(std::vector<Stmt*>& stmts, ValueNumbering& vn){
+    for(Stmt* s : stmts){
+        visit(s, vn);
+    }
+}
+
+void visit(Stmt* stmt, ValueNumbering& vn){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+        vn.assigned(decl->name);
+        return;
+    }
+
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        vn.rewrite(&declInit->expr);
+        vn.assigned(declInit->name);
+        return;
+    }
+
+    if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        vn.rewrite(&assign->expr);
+        vn.assigned(assign->name);
+        for(const TempStep& step : assign->steps){
+            vn.temps[step.slot] = vn.next++;
+        }
+        return;
+    }
+
+    if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+        vn.rewrite(&tempAssign->expr);
+        vn.temps[tempAssign->slot] = vn.numberOf(tempAssign->expr);
+        return;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        visitList(blockStmt->statements, vn);
+        return;
+    }
+
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        vn.rewrite(&ifStmt->condition);
+
+        // each branch starts from what held after the condition
+        ValueNumbering elseVn = vn;
+        visit(ifStmt->thenStmt, vn);
+        if(ifStmt->elseStmt) visit(ifStmt->elseStmt, elseVn);
+        vn.next = std::max(vn.next, elseVn.next);
+        vn.clear();
+        return;
+    }
+
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        // the condition runs again after every iteration, with different values
+        vn.clear();
+        vn.rewrite(&whileStmt->condition);
+        visit(whileStmt->body, vn);
+        vn.clear();
+        return;
+    }
+}
+
+} // namespace
+
+void eliminateCommonSubexpressions(std::vector<Stmt*>& stmts){
+    ValueNumbering vn;
+    visitList(stmts, vn);
+}
@@ -0,0 +1,98 @@
+// definite declaration analysis.
+// walks the program in execution order with the set of variables that are declared on every
+// path reaching the current point (see stepDeclared in optimize.cpp). a variable read or an
+// assignment whose name is in that set can never fail its "is it declared" check, so the site
+// is marked and the interpreter skips the check:
+//
+//   var i = 0;
+//   while (i < 10) i = i + 1;     all three uses of i are proven
+//   if (c) var x = 1;
+//   y = x;                         x may not exist here -> warning, check stays
+//
+// a read that did not throw also proves its variable for everything evaluated after it.
+// a loop body is analysed with what is known on entry to the loop: later iterations can only
+// know more, so whatever holds for the first one holds for all of them.
+// sites that can not be proven are reported on stderr before the program runs, once per name.
+
+#include "optimize.hpp"
+#include<iostream>
+
+namespace {
+
+struct DeclChecker {
+    std::set<std::string> warnedReads;
+    std::set<std::string> warnedAssigns;
+    std::set<VarExpr*> sharedSeen;
+
+    void expr(Expr* expr, std::set<std::string>& declared){
+        if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+            bool proven = declared.count(varExpr->name) > 0;
+            // a node shared by hash-consing skips the check only if every use of it is proven
+            if(varExpr->interned && !sharedSeen.insert(varExpr).second){
+                varExpr->provenDeclared = varExpr->provenDeclared && proven;
+            }else{
+                varExpr->provenDeclared = proven;
+            }
+            if(proven){
+                optStats.checksRemoved++;
+            }else if(warnedReads.insert(varExpr->name).second){
+                std::cerr<<"Warning: variable '"<<varExpr->name<<"' may be used before it is declared\n";
+            }
+            declared.insert(varExpr->name);
+        }else if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+            this->expr(binExpr->left, declared);
+            this->expr(binExpr->right, declared);
+        }else if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+            this->expr(tempStore->expr, declared);
+        }else if(auto select = dynamic_cast<SelectExpr*>(expr)){
+            this->expr(select->condition, declared);
+            this->expr(select->ifTrue, declared);
+            this->expr(select->ifFalse, declared);
+        }
+    }
+
+    void stmt(Stmt* stmt, std::set<std::string>& declared){
+        if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+            declared.insert(decl->name);
+        }else if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+            expr(declInit->expr, declared);
+            declared.insert(declInit->name);
+        }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+            // the target is checked before the value is evaluated
+            assign->provenDeclared = declared.count(assign->name) > 0;
+            if(assign->provenDeclared){
+                optStats.checksRemoved++;
+            }else if(warnedAssigns.insert(assign->name).second){
+                std::cerr<<"Warning: variable '"<<assign->name<<"' may be assigned before it is declared\n";
+            }
+            declared.insert(assign->name);
+            expr(assign->expr, declared);
+        }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+            expr(tempAssign->expr, declared);
+        }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+            expr(ifStmt->condition, declared);
+            std::set<std::string> elseDeclared = declared;
+            this->stmt(ifStmt->thenStmt, declared);
+            if(ifStmt->elseStmt) this->stmt(ifStmt->elseStmt, elseDeclared);
+            declared = intersect(declared, elseDeclared);
+        }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+            expr(whileStmt->condition, declared);
+            std::set<std::string> bodyDeclared = declared;
+            this->stmt(whileStmt->body, bodyDeclared);
+        }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+            for(Stmt* s : blockStmt->statements){
+                this->stmt(s, declared);
+            }
+        }
+    }
+};
+
+} // namespace
+
+void checkDeclarations(std::vector<Stmt*>& stmts){
+    DeclChecker checker;
+    std::set<std::string> declared;
+    for(Stmt* s : stmts){
+        checker.stmt(s, declared);
+    }
+}
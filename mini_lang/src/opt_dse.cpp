@@ -0,0 +1,196 @@
+// dead store elimination.
+// a backward liveness pass: a variable is live at a point if some path from there reads it
+// before writing it. the symbol table dump at the end of the program reads every variable,
+// so only stores that are overwritten on every path before any read can go:
+//
+//   x = a * b;  x = c;     ->    x = c;
+//   var y = f;  y = 2;     ->    var y;  y = 2;      (the declaration itself has to stay)
+//
+// a store is only removed when executing it could not have thrown: the target must be
+// declared on every path reaching it ("Cannot assign to undeclated variable"), the value may
+// only read declared variables ("Undefined variable") and may not divide by anything but a
+// literal other than 0 and -1 ("Division by zero"). values that save a temporary for later
+// reads (TempStoreExpr) are kept as well.
+
+#include "optimize.hpp"
+
+namespace {
+
+void collectReads(Expr* expr, std::set<std::string>& names){
+    noteReads(expr, names);
+}
+
+// can evaluating expr throw, given the variables in declared exist?
+bool mayThrow(Expr* expr, const std::set<std::string>& declared){
+    if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+        return !declared.count(varExpr->name);
+    }
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        if(binExpr->op == '/'){
+            auto divisor = dynamic_cast<IntExpr*>(binExpr->right);
+            if(!divisor || divisor->value == 0 || divisor->value == -1) return true;
+        }
+        return mayThrow(binExpr->left, declared) || mayThrow(binExpr->right, declared);
+    }
+    if(dynamic_cast<TempStoreExpr*>(expr)) return true;
+    return false;
+}
+
+// forward pass: which stores could be removed without losing an error
+void findRemovable(Stmt* stmt, std::set<std::string>& declared, std::set<Stmt*>& removable){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+        if(declared.count(decl->name)) removable.insert(stmt);
+    }else if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        if(!mayThrow(declInit->expr, declared)) removable.insert(stmt);
+    }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        // an induction variable step also steps temporaries, it has to stay
+        bool steps = !assign->steps.empty();
+        if(declared.count(assign->name) && !mayThrow(assign->expr, declared) && !steps) removable.insert(stmt);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        noteReads(ifStmt->condition, declared);
+        std::set<std::string> elseDeclared = declared;
+        findRemovable(ifStmt->thenStmt, declared, removable);
+        if(ifStmt->elseStmt) findRemovable(ifStmt->elseStmt, elseDeclared, removable);
+        declared = intersect(declared, elseDeclared);
+        return;
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        // later iterations only know more, the first one is the conservative case
+        noteReads(whileStmt->condition, declared);
+        std::set<std::string> bodyDeclared = declared;
+        findRemovable(whileStmt->body, bodyDeclared, removable);
+        return;
+    }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        for(Stmt* s : blockStmt->statements){
+            findRemovable(s, declared, removable);
+        }
+        return;
+    }
+    stepDeclared(stmt, declared);
+}
+
+struct Eliminator {
+    const std::set<Stmt*>& removable;
+
+    explicit Eliminator(const std::set<Stmt*>& r) : removable(r) {}
+
+    // live holds the variables live after stmt on entry and live before it on return.
+    // with rewrite set, dead stores are dropped (nullptr = statement removed)
+    Stmt* visit(Stmt* stmt, std::set<std::string>& live, bool rewrite){
+        if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+            bool dead = !live.count(decl->name) && removable.count(stmt);
+            live.erase(decl->name);
+            if(dead && rewrite){
+                delete stmt;
+                optStats.storesEliminated++;
+                return nullptr;
+            }
+            return stmt;
+        }
+
+        if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+            bool dead = !live.count(declInit->name) && removable.count(stmt);
+            live.erase(declInit->name);
+            if(dead){
+                if(!rewrite) return stmt;
+                // keep the declaration, drop the value
+                Stmt* replacement = new VarDeclStmt(declInit->name);
+                delete stmt;
+                optStats.storesEliminated++;
+                return replacement;
+            }
+            collectReads(declInit->expr, live);
+            return stmt;
+        }
+
+        if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+            bool dead = !live.count(assign->name) && removable.count(stmt);
+            if(dead){
+                if(!rewrite) return stmt;
+                delete stmt;
+                optStats.storesEliminated++;
+                return nullptr;
+            }
+            live.erase(assign->name);
+            collectReads(assign->expr, live);
+            return stmt;
+        }
+
+        if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+            collectReads(tempAssign->expr, live);
+            return stmt;
+        }
+
+        if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+            std::set<std::string> elseLive = live;
+            Stmt* thenS = visit(ifStmt->thenStmt, live, rewrite);
+            Stmt* elseS = ifStmt->elseStmt ? visit(ifStmt->elseStmt, elseLive, rewrite) : nullptr;
+            if(rewrite){
+                ifStmt->thenStmt = thenS ? thenS : new BlockStmt({});
+                ifStmt->elseStmt = elseS;
+            }
+            live.insert(elseLive.begin(), elseLive.end());
+            collectReads(ifStmt->condition, live);
+            return stmt;
+        }
+
+        if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+            // live at the loop head: live after the loop, read by the condition, or live at
+            // the start of the body (which loops back to the head)
+            std::set<std::string> head = live;
+            collectReads(whileStmt->condition, head);
+            while(true){
+                std::set<std::string> bodyLive = head;
+                visit(whileStmt->body, bodyLive, false);
+                size_t before = head.size();
+                head.insert(bodyLive.begin(), bodyLive.end());
+                if(head.size() == before) break;
+            }
+
+            if(rewrite){
+                std::set<std::string> bodyLive = head;
+                Stmt* body = visit(whileStmt->body, bodyLive, true);
+                whileStmt->body = body ? body : new BlockStmt({});
+            }
+            live = head;
+            return stmt;
+        }
+
+        if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+            visitList(blockStmt->statements, live, rewrite);
+            return stmt;
+        }
+
+        return stmt;
+    }
+
+    void visitList(std::vector<Stmt*>& stmts, std::set<std::string>& live, bool rewrite){
+        for(size_t i = stmts.size(); i-- > 0;){
+            stmts[i] = visit(stmts[i], live, rewrite);
+        }
+        if(rewrite){
+            size_t out = 0;
+            for(Stmt* s : stmts){
+                if(s) stmts[out++] = s;
+            }
+            stmts.resize(out);
+        }
+    }
+};
+
+} // namespace
+
+void eliminateDeadStores(std::vector<Stmt*>& stmts){
+    std::set<Stmt*> removable;
+    std::set<std::string> declared;
+    for(Stmt* s : stmts){
+        findRemovable(s, declared, removable);
+    }
+
+    // the final symbol table dump reads every variable
+    std::set<std::string> live;
+    for(Stmt* s : stmts){
+        collectAssigned(s, live);
+    }
+
+    Eliminator(removable).visitList(stmts, live, true);
+}
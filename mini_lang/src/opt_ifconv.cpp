@@ -0,0 +1,133 @@
+// if-conversion.
+// an if whose branches each just assign a cheap value to the same variable only decides
+// which value gets stored. it becomes one assignment of a SelectExpr, which evaluates both
+// values and picks one with a mask, so there is no branch left to mispredict:
+//
+//   if (x > y) m = x; else m = y;     ->    m = select(x > y, x, y)
+//   if (x < 0) n = n + 1;             ->    n = select(x < 0, n + 1, n)
+//
+// both values are now computed every time, so they must not be able to throw: every
+// variable they read has to be declared, and a division needs a literal divisor that can
+// not trap. the target has to be declared before the if as well, otherwise the
+// "Cannot assign" check would move in front of the condition.
+// only values of at most maxValueSize nodes are converted.
+// the pass only runs with --if-convert: the tree walker pays far more for dispatching the
+// extra nodes than a mispredicted branch costs (bench/select_bench.cpp), it is meant for
+// backends where a branch is the expensive part.
+
+#include "optimize.hpp"
+
+namespace {
+
+const int maxValueSize = 3;
+
+// the single assignment a branch consists of, if that is all it is
+AssignStmt* singleAssign(Stmt* stmt){
+    while(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        if(blockStmt->statements.size() != 1) return nullptr;
+        stmt = blockStmt->statements[0];
+    }
+    auto assign = dynamic_cast<AssignStmt*>(stmt);
+    // induction steps (opt_ivsr.cpp) have to stay conditional
+    if(!assign || !assign->steps.empty()) return nullptr;
+    return assign;
+}
+
+// can be evaluated unconditionally: no error, no side effect
+bool safe(Expr* expr, const std::set<std::string>& declared){
+    if(dynamic_cast<IntExpr*>(expr) || dynamic_cast<TempExpr*>(expr)) return true;
+
+    if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+        return declared.count(varExpr->name) > 0;
+    }
+
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        if(binExpr->op == '/'){
+            auto divisor = dynamic_cast<IntExpr*>(binExpr->right);
+            if(!divisor || divisor->value == 0 || divisor->value == -1) return false;
+        }
+        return safe(binExpr->left, declared) && safe(binExpr->right, declared);
+    }
+
+    return false;
+}
+
+// the assignment replacing ifStmt, or nullptr if it can not be converted
+AssignStmt* convert(IfStmt* ifStmt, const std::set<std::string>& declared){
+    AssignStmt* thenAssign = singleAssign(ifStmt->thenStmt);
+    if(!thenAssign || !declared.count(thenAssign->name)) return nullptr;
+
+    AssignStmt* elseAssign = nullptr;
+    if(ifStmt->elseStmt){
+        elseAssign = singleAssign(ifStmt->elseStmt);
+        if(!elseAssign || elseAssign->name != thenAssign->name) return nullptr;
+    }
+
+    // the values are computed after the condition, whatever it read exists by then
+    std::set<std::string> afterCondition = declared;
+    noteReads(ifStmt->condition, afterCondition);
+
+    Expr* ifFalse = elseAssign ? elseAssign->expr : nullptr;
+    if(!safe(thenAssign->expr, afterCondition) || exprSize(thenAssign->expr) > maxValueSize) return nullptr;
+    if(ifFalse && (!safe(ifFalse, afterCondition) || exprSize(ifFalse) > maxValueSize)) return nullptr;
+
+    // without an else the variable keeps its value
+    if(!ifFalse) ifFalse = new VarExpr(thenAssign->name);
+    if(elseAssign) elseAssign->expr = nullptr;
+
+    auto assign = new AssignStmt(thenAssign->name, new SelectExpr(ifStmt->condition, thenAssign->expr, ifFalse));
+    ifStmt->condition = nullptr;
+    thenAssign->expr = nullptr;
+    return assign;
+}
+
+Stmt* visit(Stmt* stmt, std::set<std::string>& declared);
+
+void visitList(std::vector<Stmt*>& stmts, std::set<std::string>& declared){
+    for(Stmt*& s : stmts){
+        s = visit(s, declared);
+    }
+}
+
+Stmt* visit(Stmt* stmt, std::set<std::string>& declared){
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        if(AssignStmt* assign = convert(ifStmt, declared)){
+            optStats.ifsConverted++;
+            delete ifStmt;
+            stepDeclared(assign, declared);
+            return assign;
+        }
+
+        noteReads(ifStmt->condition, declared);
+        std::set<std::string> elseDeclared = declared;
+        ifStmt->thenStmt = visit(ifStmt->thenStmt, declared);
+        if(ifStmt->elseStmt) ifStmt->elseStmt = visit(ifStmt->elseStmt, elseDeclared);
+        declared = intersect(declared, elseDeclared);
+        return stmt;
+    }
+
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        noteReads(whileStmt->condition, declared);
+        // a closed form loop only runs its body a few times
+        if(dynamic_cast<ClosedFormWhileStmt*>(stmt)) return stmt;
+
+        std::set<std::string> bodyDeclared = declared;
+        whileStmt->body = visit(whileStmt->body, bodyDeclared);
+        return stmt;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        visitList(blockStmt->statements, declared);
+        return stmt;
+    }
+
+    stepDeclared(stmt, declared);
+    return stmt;
+}
+
+} // namespace
+
+void convertIfs(std::vector<Stmt*>& stmts){
+    std::set<std::string> declared;
+    visitList(stmts, declared);
+}
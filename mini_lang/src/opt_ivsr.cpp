@@ -0,0 +1,272 @@
+// induction variable strength reduction.
+// a basic induction variable of a while loop is written exactly once in the loop, by an
+// assignment of the form i = i + c (anywhere in the body). an expression that is a
+// polynomial of degree 1 or 2 in i (with literal coefficients) and multiplies by i is kept
+// in a temporary instead, which is stepped with additions every time i is:
+//
+//   while (i < n) {                    t0 = i * 2; t1 = (i + 1) * (i - 1); t2 = i * 2 + 1;
+//       x = x + i * 2;                 while (i < n) {
+//       y = (i + 1) * (i - 1);             x = x + t0;
+//       i = i + 1;                         y = t1;
+//   }                                      i = i + 1;      also: t0 += 2, t1 += t2, t2 += 2
+//                                      }
+//
+// a degree 2 polynomial needs a second temporary holding its difference to the next step.
+// the additions are attached to the assignment of i (AssignStmt::steps) rather than being
+// statements of their own, so they cost next to nothing even when the expressions they
+// replace only run on some iterations.
+// everything is arithmetic mod 2^32, so the temporaries wrap exactly like the expressions
+// they replace. i has to be declared on entry to the loop: computing the start values in
+// front of the loop then can not throw.
+
+#include "optimize.hpp"
+#include<map>
+#include<tuple>
+
+namespace {
+
+// c[0] + c[1] * i + c[2] * i^2, mod 2^32
+struct Poly {
+    unsigned c[3] = {0, 0, 0};
+    int degree = 0;             // of the expression as written, (i - i) * i counts as 2
+    bool multiplies = false;    // has a '*' with i on one side
+};
+
+bool polyOf(Expr* expr, const std::string& iv, Poly& out){
+    if(auto intExpr = dynamic_cast<IntExpr*>(expr)){
+        out.c[0] = (unsigned)intExpr->value;
+        return true;
+    }
+    if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+        if(varExpr->name != iv) return false;
+        out.c[1] = 1;
+        out.degree = 1;
+        return true;
+    }
+
+    auto binExpr = dynamic_cast<BinaryExpr*>(expr);
+    if(!binExpr) return false;
+    Poly l, r;
+    if(!polyOf(binExpr->left, iv, l) || !polyOf(binExpr->right, iv, r)) return false;
+
+    switch(binExpr->op){
+        case '+':
+        case '-':
+        case 'n':
+            for(int k = 0; k < 3; k++){
+                out.c[k] = binExpr->op == '+' ? l.c[k] + r.c[k] : l.c[k] - r.c[k];
+            }
+            out.degree = std::max(l.degree, r.degree);
+            out.multiplies = l.multiplies || r.multiplies;
+            return true;
+        case '*':
+            if(l.degree + r.degree > 2) return false;
+            for(int a = 0; a <= l.degree; a++){
+                for(int b = 0; b <= r.degree; b++){
+                    out.c[a + b] += l.c[a] * r.c[b];
+                }
+            }
+            out.degree = l.degree + r.degree;
+            out.multiplies = l.multiplies || r.multiplies || out.degree > 0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// how often each name is written in a loop (declarations included), and by which
+// assignment when that is the only write
+struct Writes {
+    int count = 0;
+    AssignStmt* assign = nullptr;
+    bool closedForm = false;    // written in a closed form loop, which skips most of its steps
+};
+
+void collectWrites(Stmt* stmt, std::map<std::string, Writes>& writes){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+        writes[decl->name].count++;
+    }else if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        writes[declInit->name].count++;
+    }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        writes[assign->name].count++;
+        writes[assign->name].assign = assign;
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        collectWrites(ifStmt->thenStmt, writes);
+        if(ifStmt->elseStmt) collectWrites(ifStmt->elseStmt, writes);
+    }else if(auto closedForm = dynamic_cast<ClosedFormWhileStmt*>(stmt)){
+        // its body runs degree + 1 times and the variables jump to their final values, so
+        // steps attached to an assignment in there would miss the iterations in between
+        std::map<std::string, Writes> inner;
+        collectWrites(closedForm->body, inner);
+        for(const auto& entry : inner){
+            writes[entry.first].count += entry.second.count;
+            writes[entry.first].closedForm = true;
+        }
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        collectWrites(whileStmt->body, writes);
+    }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        for(Stmt* s : blockStmt->statements){
+            collectWrites(s, writes);
+        }
+    }
+}
+
+Expr* literal(unsigned v){
+    return new IntExpr((int)v);
+}
+
+// a * i + b, without the parts that do nothing
+Expr* linear(const std::string& iv, unsigned a, unsigned b){
+    Expr* product = new VarExpr(iv);
+    if(a != 1) product = new BinaryExpr('*', product, literal(a));
+    if(b == 0) return product;
+    return new BinaryExpr('+', product, literal(b));
+}
+
+// the temporaries for the polynomials of one induction variable
+struct Reducer {
+    std::string iv;
+    unsigned step;
+    std::map<std::tuple<unsigned, unsigned, unsigned>, int> slots;
+    std::vector<Stmt*> init;        // in front of the loop
+    std::vector<TempStep> update;   // along with "i = i + step"
+
+    int slotFor(const Poly& p){
+        auto key = std::make_tuple(p.c[0], p.c[1], p.c[2]);
+        auto it = slots.find(key);
+        if(it != slots.end()) return it->second;
+
+        int slot = newTempSlot();
+        slots[key] = slot;
+        if(p.c[2] == 0){
+            init.push_back(new TempAssignStmt(slot, linear(iv, p.c[1], p.c[0])));
+            update.push_back(TempStep{slot, -1, (int)(p.c[1] * step)});
+            return slot;
+        }
+
+        // p(i + s) - p(i) = 2 c2 s i + c2 s^2 + c1 s, which itself grows by 2 c2 s^2
+        int diff = newTempSlot();
+        Expr* start = new BinaryExpr('+', new BinaryExpr('*', linear(iv, p.c[2], p.c[1]), new VarExpr(iv)), literal(p.c[0]));
+        init.push_back(new TempAssignStmt(slot, start));
+        init.push_back(new TempAssignStmt(diff, linear(iv, 2 * p.c[2] * step, p.c[2] * step * step + p.c[1] * step)));
+        update.push_back(TempStep{slot, diff, 0});
+        update.push_back(TempStep{diff, -1, (int)(2 * p.c[2] * step * step)});
+        return slot;
+    }
+
+    // replaces the largest qualifying subtrees of expr
+    Expr* rewrite(Expr* expr){
+        Poly p;
+        if(polyOf(expr, iv, p) && p.multiplies && p.degree > 0){
+            optStats.inductionsReduced++;
+            Expr* replacement = p.c[1] == 0 && p.c[2] == 0 ? literal(p.c[0]) : new TempExpr(slotFor(p));
+            delete expr;
+            return replacement;
+        }
+        if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+            binExpr->left = rewrite(binExpr->left);
+            binExpr->right = rewrite(binExpr->right);
+        }else if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+            tempStore->expr = rewrite(tempStore->expr);
+        }
+        return expr;
+    }
+
+    void rewriteStmt(Stmt* stmt){
+        if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+            declInit->expr = rewrite(declInit->expr);
+        }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+            assign->expr = rewrite(assign->expr);
+        }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+            tempAssign->expr = rewrite(tempAssign->expr);
+        }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+            ifStmt->condition = rewrite(ifStmt->condition);
+            rewriteStmt(ifStmt->thenStmt);
+            if(ifStmt->elseStmt) rewriteStmt(ifStmt->elseStmt);
+        }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+            whileStmt->condition = rewrite(whileStmt->condition);
+            rewriteStmt(whileStmt->body);
+        }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+            for(Stmt* s : blockStmt->statements){
+                rewriteStmt(s);
+            }
+        }
+    }
+};
+
+// reduces the expressions of every basic induction variable of loop, returns the
+// statements that have to run in front of it
+std::vector<Stmt*> reduceLoop(WhileStmt* loop, const std::set<std::string>& declared){
+    std::map<std::string, Writes> writes;
+    collectWrites(loop->body, writes);
+
+    std::vector<Stmt*> init;
+    for(const auto& entry : writes){
+        AssignStmt* assign = entry.second.assign;
+        int step;
+        if(entry.second.count != 1 || !assign || entry.second.closedForm || !declared.count(entry.first)) continue;
+        if(!inductionStep(assign->expr, entry.first, step)) continue;
+
+        Reducer reducer;
+        reducer.iv = entry.first;
+        reducer.step = (unsigned)step;
+        loop->condition = reducer.rewrite(loop->condition);
+        reducer.rewriteStmt(loop->body);
+
+        init.insert(init.end(), reducer.init.begin(), reducer.init.end());
+        assign->steps.insert(assign->steps.end(), reducer.update.begin(), reducer.update.end());
+    }
+    return init;
+}
+
+Stmt* visit(Stmt* stmt, std::set<std::string>& declared);
+
+void visitList(std::vector<Stmt*>& stmts, std::set<std::string>& declared){
+    for(Stmt*& s : stmts){
+        s = visit(s, declared);
+    }
+}
+
+Stmt* visit(Stmt* stmt, std::set<std::string>& declared){
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        // a closed form loop only runs its body a few times
+        if(dynamic_cast<ClosedFormWhileStmt*>(stmt)){
+            noteReads(whileStmt->condition, declared);
+            return stmt;
+        }
+
+        std::vector<Stmt*> init = reduceLoop(whileStmt, declared);
+
+        noteReads(whileStmt->condition, declared);
+        std::set<std::string> bodyDeclared = declared;
+        whileStmt->body = visit(whileStmt->body, bodyDeclared);
+
+        if(init.empty()) return stmt;
+        init.push_back(whileStmt);
+        return new BlockStmt(init);
+    }
+
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        noteReads(ifStmt->condition, declared);
+        std::set<std::string> elseDeclared = declared;
+        ifStmt->thenStmt = visit(ifStmt->thenStmt, declared);
+        if(ifStmt->elseStmt) ifStmt->elseStmt = visit(ifStmt->elseStmt, elseDeclared);
+        declared = intersect(declared, elseDeclared);
+        return stmt;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        visitList(blockStmt->statements, declared);
+        return stmt;
+    }
+
+    stepDeclared(stmt, declared);
+    return stmt;
+}
+
+} // namespace
+
+void reduceInductionVariables(std::vector<Stmt*>& stmts){
+    std::set<std::string> declared;
+    visitList(stmts, declared);
+}
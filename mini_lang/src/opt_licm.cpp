@@ -0,0 +1,141 @@
+// loop invariant code motion.
+// for every while loop we collect the variables the body writes. a binary expression inside
+// the loop (condition or body) that only reads other variables computes the same value on
+// every iteration, so we evaluate it once in front of the loop into a temporary:
+//
+//   while (i < limit * 2) { ... }    ->    t0 = limit * 2; while (i < t0) { ... }
+//
+// the hoisted code runs even when the loop body never does, so it must not be able to throw:
+// every variable it reads has to be declared on all paths into the loop, and a division is
+// only moved when its divisor is a literal that can not trap (not 0, not -1).
+
+#include "optimize.hpp"
+
+namespace {
+
+struct Hoister {
+    const std::set<std::string>& assigned;     // written somewhere in the loop
+    const std::set<std::string>& declared;     // declared on entry to the loop
+    std::vector<TempAssignStmt*> hoisted;      // goes in front of the loop
+
+    Hoister(const std::set<std::string>& a, const std::set<std::string>& d) : assigned(a), declared(d) {}
+
+    bool invariant(Expr* expr) const {
+        if(dynamic_cast<IntExpr*>(expr)) return true;
+
+        if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+            return !assigned.count(varExpr->name) && declared.count(varExpr->name);
+        }
+
+        if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+            if(binExpr->op == '/'){
+                auto divisor = dynamic_cast<IntExpr*>(binExpr->right);
+                if(!divisor || divisor->value == 0 || divisor->value == -1) return false;
+            }
+            return invariant(binExpr->left) && invariant(binExpr->right);
+        }
+
+        return false;
+    }
+
+    // replace the largest invariant subtrees of expr by temporaries
+    Expr* hoist(Expr* expr){
+        auto binExpr = dynamic_cast<BinaryExpr*>(expr);
+        if(!binExpr) return expr;
+
+        if(!invariant(binExpr)){
+            binExpr->left = hoist(binExpr->left);
+            binExpr->right = hoist(binExpr->right);
+            return expr;
+        }
+
+        // the same expression hoisted earlier for this loop shares its temporary
+        for(TempAssignStmt* t : hoisted){
+            if(sameExpr(t->expr, expr)){
+                delete expr;
+                return new TempExpr(t->slot);
+            }
+        }
+
+        TempAssignStmt* t = new TempAssignStmt(newTempSlot(), expr);
+        hoisted.push_back(t);
+        optStats.expressionsHoisted++;
+        return new TempExpr(t->slot);
+    }
+
+    void hoistStmt(Stmt* stmt){
+        if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+            declInit->expr = hoist(declInit->expr);
+        }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+            assign->expr = hoist(assign->expr);
+        }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+            tempAssign->expr = hoist(tempAssign->expr);
+        }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+            ifStmt->condition = hoist(ifStmt->condition);
+            hoistStmt(ifStmt->thenStmt);
+            if(ifStmt->elseStmt) hoistStmt(ifStmt->elseStmt);
+        }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+            whileStmt->condition = hoist(whileStmt->condition);
+            hoistStmt(whileStmt->body);
+        }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+            for(Stmt* s : blockStmt->statements){
+                hoistStmt(s);
+            }
+        }
+    }
+};
+
+Stmt* visit(Stmt* stmt, std::set<std::string>& declared);
+
+void visitList(std::vector<Stmt*>& stmts, std::set<std::string>& declared){
+    for(Stmt*& s : stmts){
+        s = visit(s, declared);
+    }
+}
+
+// outer loops are handled before the loops nested in them, so an expression that is
+// invariant in both ends up in front of the outermost one
+Stmt* visit(Stmt* stmt, std::set<std::string>& declared){
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        std::set<std::string> assigned;
+        collectAssigned(whileStmt->body, assigned);
+
+        Hoister hoister(assigned, declared);
+        whileStmt->condition = hoister.hoist(whileStmt->condition);
+        hoister.hoistStmt(whileStmt->body);
+
+        noteReads(whileStmt->condition, declared);
+        std::set<std::string> bodyDeclared = declared;
+        whileStmt->body = visit(whileStmt->body, bodyDeclared);
+
+        if(hoister.hoisted.empty()) return stmt;
+
+        std::vector<Stmt*> stmts(hoister.hoisted.begin(), hoister.hoisted.end());
+        stmts.push_back(whileStmt);
+        return new BlockStmt(stmts);
+    }
+
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        noteReads(ifStmt->condition, declared);
+        std::set<std::string> elseDeclared = declared;
+        ifStmt->thenStmt = visit(ifStmt->thenStmt, declared);
+        if(ifStmt->elseStmt) ifStmt->elseStmt = visit(ifStmt->elseStmt, elseDeclared);
+        declared = intersect(declared, elseDeclared);
+        return stmt;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        visitList(blockStmt->statements, declared);
+        return stmt;
+    }
+
+    stepDeclared(stmt, declared);
+    return stmt;
+}
+
+} // namespace
+
+void hoistLoopInvariants(std::vector<Stmt*>& stmts){
+    std::set<std::string> declared;
+    visitList(stmts, declared);
+}
@@ -0,0 +1,358 @@
+// value range analysis.
+// walks the statement tree with an interval [lo, hi] for every variable and temporary.
+// conditions narrow the intervals on each side of an if and inside / after a while loop:
+//
+//   var i = 1;
+//   while (i < n) {          i in [1, INT_MAX - 1] inside the loop
+//       s = s + 1000 / i;    divisor can not be 0: the zero check is dropped
+//       i = i + 1;
+//   }
+//
+// loops are iterated until the intervals at the loop head stop growing. after a few rounds
+// any bound that still moves is widened to INT_MIN / INT_MAX so this always ends, then one
+// more round without widening wins back what the condition bounds (i < 100 -> [1, 100]).
+// arithmetic that could wrap around gives the full int range.
+//
+// every BinaryExpr gets the range of its result (minValue / maxValue) and divisions whose
+// divisor range excludes 0 get divisorNonZero, which makes the interpreter skip the check.
+
+#include "optimize.hpp"
+#include<algorithm>
+#include<climits>
+#include<map>
+
+namespace {
+
+struct Range {
+    long long lo = INT_MIN;
+    long long hi = INT_MAX;
+
+    bool operator==(const Range& o) const { return lo == o.lo && hi == o.hi; }
+    bool contains(long long v) const { return lo <= v && v <= hi; }
+};
+
+const Range full;
+
+Range exactly(long long v){
+    return Range{v, v};
+}
+
+// arithmetic results outside int wrap around, so anything could come out
+Range fit(long long lo, long long hi){
+    if(lo < INT_MIN || hi > INT_MAX) return full;
+    return Range{lo, hi};
+}
+
+Range hull(const Range& a, const Range& b){
+    return Range{std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+struct State {
+    bool reachable = true;
+    std::map<std::string, Range> vars;     // missing entry = nothing known
+    std::map<int, Range> temps;
+
+    bool operator==(const State& o) const {
+        return reachable == o.reachable && vars == o.vars && temps == o.temps;
+    }
+};
+
+template<typename K>
+std::map<K, Range> joinMap(const std::map<K, Range>& a, const std::map<K, Range>& b){
+    std::map<K, Range> r;
+    for(const auto& entry : a){
+        auto it = b.find(entry.first);
+        if(it != b.end()) r[entry.first] = hull(entry.second, it->second);
+    }
+    return r;
+}
+
+State join(const State& a, const State& b){
+    if(!a.reachable) return b;
+    if(!b.reachable) return a;
+    State r;
+    r.vars = joinMap(a.vars, b.vars);
+    r.temps = joinMap(a.temps, b.temps);
+    return r;
+}
+
+// bounds that grew since the last round jump to the end of the int range
+template<typename K>
+void widenMap(std::map<K, Range>& now, const std::map<K, Range>& before){
+    for(auto& entry : now){
+        auto it = before.find(entry.first);
+        if(it == before.end()) continue;
+        if(entry.second.lo < it->second.lo) entry.second.lo = INT_MIN;
+        if(entry.second.hi > it->second.hi) entry.second.hi = INT_MAX;
+    }
+}
+
+Range lookup(const State& st, const std::string& name){
+    auto it = st.vars.find(name);
+    return it != st.vars.end() ? it->second : full;
+}
+
+Range lookupTemp(const State& st, int slot){
+    auto it = st.temps.find(slot);
+    return it != st.temps.end() ? it->second : full;
+}
+
+// corners of l / r for a divisor range that does not cross 0. the result is clamped
+// because the only quotient outside int is INT_MIN / -1, which traps instead
+Range divide(const Range& l, const Range& r){
+    long long q[4] = { l.lo / r.lo, l.lo / r.hi, l.hi / r.lo, l.hi / r.hi };
+    long long lo = *std::min_element(q, q + 4);
+    long long hi = *std::max_element(q, q + 4);
+    return Range{std::max(lo, (long long)INT_MIN), std::min(hi, (long long)INT_MAX)};
+}
+
+Range compare(char op, const Range& l, const Range& r){
+    bool always, never;
+    switch(op){
+        case '<': always = l.hi < r.lo;  never = l.lo >= r.hi; break;
+        case '>': always = l.lo > r.hi;  never = l.hi <= r.lo; break;
+        case 'L': always = l.hi <= r.lo; never = l.lo > r.hi;  break;
+        case 'G': always = l.lo >= r.hi; never = l.hi < r.lo;  break;
+        case 'E': always = l.lo == l.hi && r.lo == r.hi && l.lo == r.lo; never = l.hi < r.lo || r.hi < l.lo; break;
+        default:  always = l.hi < r.lo || r.hi < l.lo; never = l.lo == l.hi && r.lo == r.hi && l.lo == r.lo; break;
+    }
+    if(always) return exactly(1);
+    if(never) return exactly(0);
+    return Range{0, 1};
+}
+
+struct Analyzer {
+    bool mark = false;      // write results into the tree (only on the final round)
+
+    Range eval(Expr* expr, State& st){
+        if(auto intExpr = dynamic_cast<IntExpr*>(expr)){
+            return exactly(intExpr->value);
+        }
+        if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+            return lookup(st, varExpr->name);
+        }
+        if(auto tempExpr = dynamic_cast<TempExpr*>(expr)){
+            return lookupTemp(st, tempExpr->slot);
+        }
+        if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+            return st.temps[tempStore->slot] = eval(tempStore->expr, st);
+        }
+        if(auto select = dynamic_cast<SelectExpr*>(expr)){
+            Range c = eval(select->condition, st);
+            Range t = eval(select->ifTrue, st);
+            Range f = eval(select->ifFalse, st);
+            if(!c.contains(0)) return t;
+            return c.lo == 0 && c.hi == 0 ? f : hull(t, f);
+        }
+        auto binExpr = dynamic_cast<BinaryExpr*>(expr);
+        if(!binExpr) return full;
+
+        Range l = eval(binExpr->left, st);
+        Range r = eval(binExpr->right, st);
+        Range result = full;
+        switch(binExpr->op){
+            case '+': result = fit(l.lo + r.lo, l.hi + r.hi); break;
+            case '-':
+            case 'n': result = fit(l.lo - r.hi, l.hi - r.lo); break;
+            case '*': {
+                long long p[4] = { l.lo * r.lo, l.lo * r.hi, l.hi * r.lo, l.hi * r.hi };
+                result = fit(*std::min_element(p, p + 4), *std::max_element(p, p + 4));
+                break;
+            }
+            case '/': {
+                // a zero divisor throws, so only the negative and positive parts produce values
+                bool first = true;
+                if(r.lo < 0){
+                    result = divide(l, Range{r.lo, std::min(r.hi, -1LL)});
+                    first = false;
+                }
+                if(r.hi > 0){
+                    Range positive = divide(l, Range{std::max(r.lo, 1LL), r.hi});
+                    result = first ? positive : hull(result, positive);
+                }
+                if(mark && !r.contains(0)){
+                    binExpr->divisorNonZero = true;
+                    optStats.divisionChecksRemoved++;
+                }
+                break;
+            }
+            default: result = compare(binExpr->op, l, r); break;
+        }
+
+        if(mark){
+            binExpr->minValue = (int)result.lo;
+            binExpr->maxValue = (int)result.hi;
+        }
+        return result;
+    }
+
+    // narrow a variable (or temporary) read by a condition to the values in r
+    void narrow(Expr* expr, Range r, State& st){
+        Range current;
+        if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+            current = lookup(st, varExpr->name);
+        }else if(auto tempExpr = dynamic_cast<TempExpr*>(expr)){
+            current = lookupTemp(st, tempExpr->slot);
+        }else{
+            return;
+        }
+
+        Range n{std::max(current.lo, r.lo), std::min(current.hi, r.hi)};
+        if(n.lo > n.hi){
+            st.reachable = false;
+            return;
+        }
+        if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+            st.vars[varExpr->name] = n;
+        }else{
+            st.temps[static_cast<TempExpr*>(expr)->slot] = n;
+        }
+    }
+
+    // "left op right" is known to hold, narrow each side by the other one
+    void assume(char op, Expr* left, Expr* right, State& st){
+        State scratch = st;
+        Range l = eval(left, scratch);
+        Range r = eval(right, scratch);
+        switch(op){
+            case '<': narrow(left, Range{INT_MIN, r.hi - 1}, st); narrow(right, Range{l.lo + 1, INT_MAX}, st); break;
+            case '>': narrow(left, Range{r.lo + 1, INT_MAX}, st); narrow(right, Range{INT_MIN, l.hi - 1}, st); break;
+            case 'L': narrow(left, Range{INT_MIN, r.hi}, st);     narrow(right, Range{l.lo, INT_MAX}, st);     break;
+            case 'G': narrow(left, Range{r.lo, INT_MAX}, st);     narrow(right, Range{INT_MIN, l.hi}, st);     break;
+            case 'E': narrow(left, r, st);                         narrow(right, l, st);                         break;
+            case 'N':
+                // only helps when the other side is a single value at the edge of this range
+                if(r.lo == r.hi && l.lo == r.lo) narrow(left, Range{l.lo + 1, INT_MAX}, st);
+                if(r.lo == r.hi && l.hi == r.lo) narrow(left, Range{INT_MIN, l.hi - 1}, st);
+                if(l.lo == l.hi && r.lo == l.lo) narrow(right, Range{r.lo + 1, INT_MAX}, st);
+                if(l.lo == l.hi && r.hi == l.lo) narrow(right, Range{INT_MIN, r.hi - 1}, st);
+                break;
+        }
+    }
+
+    // state after the condition evaluated to truth. never marks the tree: the caller
+    // evaluates the condition itself for that
+    State branch(Expr* cond, const State& st, bool truth){
+        State out = st;
+        if(!out.reachable) return out;
+
+        bool marking = mark;
+        mark = false;
+        out = narrowBy(cond, out, truth);
+        mark = marking;
+        return out;
+    }
+
+    State narrowBy(Expr* cond, State out, bool truth){
+        Range value = eval(cond, out);
+        if((truth && value == exactly(0)) || (!truth && !value.contains(0))){
+            out.reachable = false;
+            return out;
+        }
+
+        auto binExpr = dynamic_cast<BinaryExpr*>(cond);
+        const std::string ops = "<>LGEN";
+        if(binExpr && ops.find(binExpr->op) != std::string::npos){
+            char op = binExpr->op;
+            if(!truth){
+                switch(op){
+                    case '<': op = 'G'; break;
+                    case '>': op = 'L'; break;
+                    case 'L': op = '>'; break;
+                    case 'G': op = '<'; break;
+                    case 'E': op = 'N'; break;
+                    case 'N': op = 'E'; break;
+                }
+            }
+            assume(op, binExpr->left, binExpr->right, out);
+        }else{
+            IntExpr zero(0);
+            assume(truth ? 'N' : 'E', cond, &zero, out);
+        }
+        return out;
+    }
+
+    void visit(Stmt* stmt, State& st){
+        if(!st.reachable) return;
+
+        if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+            st.vars[decl->name] = exactly(0);
+        }else if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+            Range r = eval(declInit->expr, st);
+            st.vars[declInit->name] = r;
+        }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+            Range r = eval(assign->expr, st);
+            st.vars[assign->name] = r;
+            for(const TempStep& step : assign->steps){
+                st.temps.erase(step.slot);
+            }
+        }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+            Range r = eval(tempAssign->expr, st);
+            st.temps[tempAssign->slot] = r;
+        }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+            if(mark) eval(ifStmt->condition, st);
+            State thenSt = branch(ifStmt->condition, st, true);
+            State elseSt = branch(ifStmt->condition, st, false);
+            visit(ifStmt->thenStmt, thenSt);
+            if(ifStmt->elseStmt) visit(ifStmt->elseStmt, elseSt);
+            st = join(thenSt, elseSt);
+        }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+            visitLoop(whileStmt, st);
+        }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+            for(Stmt* s : blockStmt->statements){
+                visit(s, st);
+            }
+        }
+    }
+
+    void visitLoop(WhileStmt* loop, State& st){
+        // the tree is only marked once the loop head is stable
+        bool marking = mark;
+        mark = false;
+
+        const State entry = st;
+        State head = entry;
+        for(int round = 0; ; round++){
+            State body = branch(loop->condition, head, true);
+            visit(loop->body, body);
+            State next = join(entry, body);
+            if(round >= 3){
+                widenMap(next.vars, head.vars);
+                widenMap(next.temps, head.temps);
+            }
+            if(next == head) break;
+            head = next;
+            if(round == 20){
+                // should not happen, but knowing nothing is always a safe answer
+                head.vars.clear();
+                head.temps.clear();
+                break;
+            }
+        }
+
+        // one more round without widening narrows the head again (still a fixpoint)
+        State body = branch(loop->condition, head, true);
+        visit(loop->body, body);
+        head = join(entry, body);
+
+        mark = marking;
+        if(mark){
+            State condSt = head;
+            eval(loop->condition, condSt);
+            State bodySt = branch(loop->condition, head, true);
+            visit(loop->body, bodySt);
+        }
+        st = branch(loop->condition, head, false);
+    }
+};
+
+} // namespace
+
+void analyzeRanges(std::vector<Stmt*>& stmts){
+    Analyzer analyzer;
+    analyzer.mark = true;
+    State st;
+    for(Stmt* s : stmts){
+        analyzer.visit(s, st);
+    }
+}
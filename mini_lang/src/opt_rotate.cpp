@@ -0,0 +1,58 @@
+// loop rotation.
+// a while loop tests its condition at the top of every iteration and, in compiled form,
+// jumps back to that test from the end of the body: two branches per iteration. a rotated
+// loop tests once on entry and then at the bottom, where the test jumps straight back to
+// the top of the body:
+//
+//   while (i < n) {          if (i < n)
+//       s = s + i;               do {
+//       i = i + 1;                   s = s + i;
+//   }                                i = i + 1;
+//                                } while (i < n);
+//
+// the condition is evaluated exactly as often and in the same places as before, so
+// nothing observable changes. the tree walker runs both forms at the same cost per
+// iteration (bench/rotate_bench.cpp) and pays for the guard on every entry, so the pass
+// only runs with --rotate-loops, as the loop shape for code generators.
+// runs last: the other passes only know while loops.
+
+#include "optimize.hpp"
+
+namespace {
+
+Stmt* rotate(Stmt* stmt){
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        ifStmt->thenStmt = rotate(ifStmt->thenStmt);
+        if(ifStmt->elseStmt) ifStmt->elseStmt = rotate(ifStmt->elseStmt);
+        return stmt;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        for(Stmt*& s : blockStmt->statements){
+            s = rotate(s);
+        }
+        return stmt;
+    }
+
+    auto whileStmt = dynamic_cast<WhileStmt*>(stmt);
+    // a closed form loop computes its own trip count from the condition
+    if(!whileStmt || dynamic_cast<ClosedFormWhileStmt*>(stmt) || dynamic_cast<DoWhileStmt*>(stmt)){
+        return stmt;
+    }
+
+    auto loop = new DoWhileStmt(whileStmt->condition, rotate(whileStmt->body));
+    whileStmt->condition = nullptr;
+    whileStmt->body = nullptr;
+    delete whileStmt;
+
+    optStats.loopsRotated++;
+    return new IfStmt(cloneExpr(loop->condition), loop);
+}
+
+} // namespace
+
+void rotateLoops(std::vector<Stmt*>& stmts){
+    for(Stmt*& s : stmts){
+        s = rotate(s);
+    }
+}
@@ -0,0 +1,213 @@
+// scalar evolution: closed form evaluation of counting loops.
+// a loop qualifies when its body is a straight list of assignments, each variable is
+// assigned once, and every assignment is one of
+//   i = i + c / i = i - c     induction variable (c a literal)
+//   s = s + f                 accumulator (s once, added, f written with any + and -)
+//   x = f                     derived value
+// where f only reads induction variables and variables the loop never writes, using
+// + - * (degree <= 3 in the induction variables). the condition must compare an induction
+// variable against something the loop never writes. such loops are replaced by a
+// ClosedFormWhileStmt, which computes the trip count at runtime and jumps straight to the
+// final values (see execClosedForm in ast.cpp).
+
+#include "optimize.hpp"
+#include<map>
+
+namespace {
+
+const int maxDegree = 3;
+
+// straight line bodies only: assignments, possibly grouped in blocks
+bool flatten(Stmt* stmt, std::vector<AssignStmt*>& out){
+    if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        out.push_back(assign);
+        return true;
+    }
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        for(Stmt* s : blockStmt->statements){
+            if(!flatten(s, out)) return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool isVar(Expr* expr, const std::string& name){
+    auto varExpr = dynamic_cast<VarExpr*>(expr);
+    return varExpr && varExpr->name == name;
+}
+
+bool reads(Expr* expr, const std::string& name){
+    if(isVar(expr, name)) return true;
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        return reads(binExpr->left, name) || reads(binExpr->right, name);
+    }
+    return false;
+}
+
+// degree of expr as a polynomial in the trip number, -1 if it is not one
+int degree(Expr* expr, const std::map<std::string, char>& kinds){
+    if(dynamic_cast<IntExpr*>(expr) || dynamic_cast<TempExpr*>(expr)) return 0;
+
+    if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+        auto it = kinds.find(varExpr->name);
+        if(it == kinds.end()) return 0;     // not written by the loop
+        return it->second == 'i' ? 1 : -1;
+    }
+
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        int l = degree(binExpr->left, kinds);
+        int r = degree(binExpr->right, kinds);
+        if(l < 0 || r < 0) return -1;
+        switch(binExpr->op){
+            case '+': case '-': case 'n': return std::max(l, r);
+            case '*': return l + r;
+            default: return l == 0 && r == 0 ? 0 : -1;   // / and comparisons of invariants
+        }
+    }
+
+    return -1;
+}
+
+// counts how often name appears in the additive chain of expr (a + b - c ...), with sign.
+// returns false if it also appears anywhere else (inside a product, a comparison, ...)
+bool additiveUses(Expr* expr, const std::string& name, int sign, int& count){
+    if(isVar(expr, name)){
+        count += sign;
+        return true;
+    }
+    auto binExpr = dynamic_cast<BinaryExpr*>(expr);
+    if(binExpr && (binExpr->op == '+' || binExpr->op == '-' || binExpr->op == 'n')){
+        int rightSign = binExpr->op == '+' ? sign : -sign;
+        return additiveUses(binExpr->left, name, sign, count) && additiveUses(binExpr->right, name, rightSign, count);
+    }
+    return !reads(expr, name);
+}
+
+// "name = name + f" in any arrangement of + and - (name = (name + a) - b, ...)
+bool isAccumulation(Expr* expr, const std::string& name){
+    int count = 0;
+    return additiveUses(expr, name, 1, count) && count == 1 && reads(expr, name);
+}
+
+char flip(char cmp){
+    switch(cmp){
+        case '<': return '>';
+        case '>': return '<';
+        case 'L': return 'G';
+        case 'G': return 'L';
+        default: return cmp;
+    }
+}
+
+// builds the closed form loop, or returns nullptr when the loop does not qualify
+ClosedFormWhileStmt* analyze(WhileStmt* loop){
+    std::vector<AssignStmt*> body;
+    if(!flatten(loop->body, body)) return nullptr;
+
+    // classify every assigned variable: i(nduction), a(ccumulator), d(erived)
+    std::map<std::string, char> kinds;
+    std::map<std::string, int> steps;
+    for(AssignStmt* assign : body){
+        if(kinds.count(assign->name)) return nullptr;   // assigned twice
+
+        int step;
+        if(inductionStep(assign->expr, assign->name, step)){
+            kinds[assign->name] = 'i';
+            steps[assign->name] = step;
+        }else if(isAccumulation(assign->expr, assign->name)){
+            kinds[assign->name] = 'a';
+        }else if(!reads(assign->expr, assign->name)){
+            kinds[assign->name] = 'd';
+        }else{
+            return nullptr;
+        }
+    }
+
+    // the added part of an accumulation (or the value of a derived variable) must be a
+    // polynomial in the induction variables. the accumulator's own read counts as degree 0,
+    // it is what the sum starts from
+    int deg = 0;
+    for(AssignStmt* assign : body){
+        if(kinds[assign->name] == 'i') continue;
+
+        std::map<std::string, char> others = kinds;
+        others.erase(assign->name);
+        int d = degree(assign->expr, others);
+        if(d < 0 || d > maxDegree) return nullptr;
+        deg = std::max(deg, d);
+    }
+
+    // condition: induction variable against something the loop does not write
+    auto cond = dynamic_cast<BinaryExpr*>(loop->condition);
+    if(!cond || std::string("<>LGN").find(cond->op) == std::string::npos) return nullptr;
+
+    auto leftVar = dynamic_cast<VarExpr*>(cond->left);
+    auto rightVar = dynamic_cast<VarExpr*>(cond->right);
+    bool onLeft;
+    std::string counter;
+    if(leftVar && kinds.count(leftVar->name) && kinds[leftVar->name] == 'i' && degree(cond->right, kinds) == 0){
+        onLeft = true;
+        counter = leftVar->name;
+    }else if(rightVar && kinds.count(rightVar->name) && kinds[rightVar->name] == 'i' && degree(cond->left, kinds) == 0){
+        onLeft = false;
+        counter = rightVar->name;
+    }else{
+        return nullptr;
+    }
+
+    auto result = new ClosedFormWhileStmt(loop->condition, loop->body);
+    result->counter = counter;
+    result->counterOnLeft = onLeft;
+    result->cmp = onLeft ? cond->op : flip(cond->op);
+    result->degree = deg;
+    for(const auto& entry : kinds){
+        if(entry.second == 'i'){
+            result->inductions.push_back(entry.first);
+            result->steps.push_back(steps[entry.first]);
+        }else if(entry.second == 'a'){
+            result->accumulators.push_back(entry.first);
+        }else{
+            result->derived.push_back(entry.first);
+        }
+    }
+    return result;
+}
+
+Stmt* visit(Stmt* stmt){
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        if(dynamic_cast<ClosedFormWhileStmt*>(stmt)) return stmt;
+
+        if(ClosedFormWhileStmt* closedForm = analyze(whileStmt)){
+            // the new node took over the condition and body
+            whileStmt->condition = nullptr;
+            whileStmt->body = nullptr;
+            delete whileStmt;
+            optStats.loopsClosedForm++;
+            return closedForm;
+        }
+        whileStmt->body = visit(whileStmt->body);
+        return stmt;
+    }
+
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        ifStmt->thenStmt = visit(ifStmt->thenStmt);
+        if(ifStmt->elseStmt) ifStmt->elseStmt = visit(ifStmt->elseStmt);
+        return stmt;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        for(Stmt*& s : blockStmt->statements){
+            s = visit(s);
+        }
+    }
+    return stmt;
+}
+
+} // namespace
+
+void evaluateClosedFormLoops(std::vector<Stmt*>& stmts){
+    for(Stmt*& s : stmts){
+        s = visit(s);
+    }
+}
@@ -0,0 +1,165 @@
+// strength reduction of multiplication and division by constants.
+// a multiplication with a literal operand is computed with shifts and at most one add /
+// subtract, a division by a literal with a multiply-high and a shift (see ConstArith in
+// ast.hpp). the node stays a BinaryExpr for every other pass, only the interpreter looks at
+// how it was lowered and then skips evaluating the literal:
+//
+//   i * 2      ->    i << 1
+//   x * 10     ->    (x << 3) + (x << 1)
+//   x / 10     ->    mulhi(x, 0x66666667) >> 2, +1 if negative
+//   x * 1, x / 1    ->    x
+//
+// factors that need more than two terms stay a plain '*'. division by 0 keeps its error,
+// division by -1 keeps its INT_MIN trap and division by INT_MIN stays as it is, so the
+// behaviour only changes in speed.
+
+#include "optimize.hpp"
+#include<climits>
+#include<utility>
+
+namespace {
+
+bool isPowerOfTwo(unsigned long long v){
+    return v != 0 && (v & (v - 1)) == 0;
+}
+
+int log2Of(unsigned long long v){
+    int k = 0;
+    while(v > 1){
+        v >>= 1;
+        k++;
+    }
+    return k;
+}
+
+// magic number and shift for signed division by d, 2 <= |d| < 2^31
+// (hacker's delight, figure 10-1)
+void divisionMagic(int d, int& magic, int& shift){
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d < 0 ? 0u - (unsigned)d : (unsigned)d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad;     // |nc|
+    int p = 31;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    do{
+        p++;
+        q1 *= 2; r1 *= 2;
+        if(r1 >= anc){ q1++; r1 -= anc; }
+        q2 *= 2; r2 *= 2;
+        if(r2 >= ad){ q2++; r2 -= ad; }
+        delta = ad - r2;
+    }while(q1 < delta || (q1 == delta && r1 == 0));
+
+    magic = (int)(q2 + 1);
+    if(d < 0) magic = -magic;
+    shift = p - 32;
+}
+
+Expr* lower(Expr* expr);
+
+void lowerStmt(Stmt* stmt){
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        declInit->expr = lower(declInit->expr);
+    }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        assign->expr = lower(assign->expr);
+    }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+        tempAssign->expr = lower(tempAssign->expr);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        ifStmt->condition = lower(ifStmt->condition);
+        lowerStmt(ifStmt->thenStmt);
+        if(ifStmt->elseStmt) lowerStmt(ifStmt->elseStmt);
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        whileStmt->condition = lower(whileStmt->condition);
+        lowerStmt(whileStmt->body);
+    }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        for(Stmt* s : blockStmt->statements){
+            lowerStmt(s);
+        }
+    }
+}
+
+Expr* lower(Expr* expr){
+    if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+        tempStore->expr = lower(tempStore->expr);
+        return expr;
+    }
+
+    auto binExpr = dynamic_cast<BinaryExpr*>(expr);
+    if(!binExpr) return expr;
+    binExpr->left = lower(binExpr->left);
+    binExpr->right = lower(binExpr->right);
+
+    // literal first: a literal can not throw, so the operands can swap places
+    if(binExpr->op == '*' && dynamic_cast<IntExpr*>(binExpr->left)){
+        std::swap(binExpr->left, binExpr->right);
+    }
+
+    auto literal = dynamic_cast<IntExpr*>(binExpr->right);
+    if(!literal || (binExpr->op != '*' && binExpr->op != '/')) return expr;
+
+    if(literal->value == 1){
+        Expr* operand = binExpr->left;
+        binExpr->left = nullptr;
+        delete binExpr;
+        optStats.strengthReduced++;
+        return operand;
+    }
+
+    bool done = binExpr->op == '*' ? lowerMultiply(literal->value, binExpr->lowered)
+                                   : lowerDivide(literal->value, binExpr->lowered);
+    if(done) optStats.strengthReduced++;
+    return expr;
+}
+
+} // namespace
+
+bool lowerMultiply(int factor, ConstArith& out){
+    // x * 0 still has to evaluate x (it may throw), nothing to gain there
+    if(factor == 0 || factor == 1) return false;
+
+    bool negative = factor < 0;
+    unsigned long long m = negative ? -(long long)factor : factor;
+    unsigned long long low = m & (0 - m);
+
+    if(isPowerOfTwo(m)){
+        out.kind = negative ? 'N' : 'S';
+        out.shiftA = log2Of(m);
+    }else if(isPowerOfTwo(m - low)){        // 2^a + 2^b
+        out.kind = negative ? 'M' : '+';
+        out.shiftA = log2Of(m - low);
+        out.shiftB = log2Of(low);
+    }else if(isPowerOfTwo(m + low)){        // 2^a - 2^b: one run of set bits
+        out.kind = '-';
+        out.shiftA = log2Of(m + low);
+        out.shiftB = log2Of(low);
+        if(negative) std::swap(out.shiftA, out.shiftB);
+    }else{
+        return false;
+    }
+    return true;
+}
+
+bool lowerDivide(int divisor, ConstArith& out){
+    if(divisor == 0 || divisor == 1 || divisor == -1 || divisor == INT_MIN) return false;
+
+    unsigned long long ad = divisor < 0 ? -(long long)divisor : divisor;
+    if(isPowerOfTwo(ad)){
+        out.kind = divisor < 0 ? 'Q' : 'P';
+        out.shiftA = log2Of(ad);
+        return true;
+    }
+
+    divisionMagic(divisor, out.magic, out.shiftA);
+    out.kind = 'D';
+    if(divisor > 0 && out.magic < 0) out.kind = 'A';
+    if(divisor < 0 && out.magic > 0) out.kind = 'B';
+    return true;
+}
+
+void reduceStrength(std::vector<Stmt*>& stmts){
+    for(Stmt* s : stmts){
+        lowerStmt(s);
+    }
+}
@@ -0,0 +1,229 @@
+// loop unrolling.
+// a counting loop "while (i cmp bound)" with a literal bound, whose counter is written only
+// by one "i = i + c" at the top level of its body, runs its body with the condition known
+// to hold several times in a row:
+//
+//   var i = 0;                        var i = 0;
+//   while (i < 3) {                   if (x > 1) y = y + i;  i = i + 1;
+//       if (x > 1) y = y + i;    ->   if (x > 1) y = y + i;  i = i + 1;
+//       i = i + 1;                    if (x > 1) y = y + i;  i = i + 1;
+//   }
+//
+// when the counter's value on entry is a known literal and the loop runs at most
+// maxFullTrips times it is replaced by that many copies of its body (full unrolling).
+// otherwise it is unrolled by optOptions.unrollFactor (--unroll-factor=N): the main loop
+// runs k copies per test, with the bound moved so all k iterations are known to run, and
+// the original loop takes the remaining iterations:
+//
+//   while (i < 1000) body      ->    while (i < 997) { body body body body }
+//                                    while (i < 1000) body
+//
+// the copies run exactly the statements the original iterations would, ifs included, so
+// errors and the final state do not change. both forms stop at maxUnrolledSize nodes.
+
+#include "optimize.hpp"
+#include<climits>
+#include<map>
+
+namespace {
+
+const int maxFullTrips = 16;
+const int maxUnrolledSize = 256;
+
+struct CountedLoop {
+    std::string counter;
+    char cmp;       // < L > G, counter on the left
+    int bound;
+    int step;       // moves the counter toward the bound
+};
+
+int countWrites(Stmt* stmt, const std::string& name){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)) return decl->name == name;
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)) return declInit->name == name;
+    if(auto assign = dynamic_cast<AssignStmt*>(stmt)) return assign->name == name;
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        return countWrites(ifStmt->thenStmt, name) + (ifStmt->elseStmt ? countWrites(ifStmt->elseStmt, name) : 0);
+    }
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)) return countWrites(whileStmt->body, name);
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        int count = 0;
+        for(Stmt* s : blockStmt->statements){
+            count += countWrites(s, name);
+        }
+        return count;
+    }
+    return 0;
+}
+
+// the counter is stepped by a statement that runs on every iteration and nothing else
+// writes it
+bool countedLoop(WhileStmt* loop, CountedLoop& out){
+    auto cond = dynamic_cast<BinaryExpr*>(loop->condition);
+    if(!cond || (cond->op != '<' && cond->op != 'L' && cond->op != '>' && cond->op != 'G')) return false;
+    auto counter = dynamic_cast<VarExpr*>(cond->left);
+    auto bound = dynamic_cast<IntExpr*>(cond->right);
+    if(!counter || !bound || countWrites(loop->body, counter->name) != 1) return false;
+
+    std::vector<Stmt*> top = { loop->body };
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(loop->body)) top = blockStmt->statements;
+
+    for(Stmt* s : top){
+        auto assign = dynamic_cast<AssignStmt*>(s);
+        int step;
+        if(!assign || assign->name != counter->name || !inductionStep(assign->expr, assign->name, step)) continue;
+
+        bool up = cond->op == '<' || cond->op == 'L';
+        if(step == 0 || (step > 0) != up) return false;
+        out = CountedLoop{counter->name, cond->op, bound->value, step};
+        return true;
+    }
+    return false;
+}
+
+bool holds(char cmp, long long value, long long bound){
+    switch(cmp){
+        case '<': return value < bound;
+        case 'L': return value <= bound;
+        case '>': return value > bound;
+        default:  return value >= bound;
+    }
+}
+
+// iterations starting from start, -1 if more than maxFullTrips
+int tripCount(const CountedLoop& loop, int start){
+    long long value = start;
+    int trips = 0;
+    while(holds(loop.cmp, value, loop.bound)){
+        if(++trips > maxFullTrips) return -1;
+        value += loop.step;
+        // the counter would wrap around, which the copies can not follow
+        if(value < INT_MIN || value > INT_MAX) return -1;
+    }
+    return trips;
+}
+
+// copies of the body, blocks flattened
+void appendCopies(Stmt* body, int copies, std::vector<Stmt*>& out){
+    for(int k = 0; k < copies; k++){
+        if(auto blockStmt = dynamic_cast<BlockStmt*>(body)){
+            for(Stmt* s : blockStmt->statements){
+                out.push_back(cloneStmt(s));
+            }
+        }else{
+            out.push_back(cloneStmt(body));
+        }
+    }
+}
+
+Stmt* unroll(WhileStmt* loop, const std::map<std::string, int>& known){
+    CountedLoop counted;
+    if(!countedLoop(loop, counted)) return loop;
+    int bodySize = stmtSize(loop->body);
+
+    auto start = known.find(counted.counter);
+    if(start != known.end()){
+        int trips = tripCount(counted, start->second);
+        if(trips >= 0 && trips * bodySize <= maxUnrolledSize){
+            // the last test only reads the counter, nothing is lost by dropping it
+            std::vector<Stmt*> copies;
+            appendCopies(loop->body, trips, copies);
+            delete loop;
+            optStats.loopsUnrolled++;
+            return new BlockStmt(copies);
+        }
+    }
+
+    int factor = optOptions.unrollFactor;
+    if(factor < 2 || factor * bodySize > maxUnrolledSize) return loop;
+
+    // counter + (factor - 1) * step still passes the test, then so do all steps before it
+    long long mainBound = (long long)counted.bound - (long long)(factor - 1) * counted.step;
+    if(mainBound < INT_MIN || mainBound > INT_MAX) return loop;
+
+    std::vector<Stmt*> copies;
+    appendCopies(loop->body, factor, copies);
+    auto mainLoop = new WhileStmt(new BinaryExpr(counted.cmp, new VarExpr(counted.counter), new IntExpr((int)mainBound)),
+                                  new BlockStmt(copies));
+    optStats.loopsPartiallyUnrolled++;
+    return new BlockStmt({ mainLoop, loop });
+}
+
+// known: variables holding a known literal at the current point
+Stmt* visit(Stmt* stmt, std::map<std::string, int>& known);
+
+void forget(Stmt* stmt, std::map<std::string, int>& known){
+    std::set<std::string> assigned;
+    collectAssigned(stmt, assigned);
+    for(const std::string& name : assigned){
+        known.erase(name);
+    }
+}
+
+void visitList(std::vector<Stmt*>& stmts, std::map<std::string, int>& known){
+    for(Stmt*& s : stmts){
+        s = visit(s, known);
+    }
+}
+
+Stmt* visit(Stmt* stmt, std::map<std::string, int>& known){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+        known[decl->name] = 0;
+        return stmt;
+    }
+
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        auto value = dynamic_cast<IntExpr*>(declInit->expr);
+        if(value) known[declInit->name] = value->value;
+        else known.erase(declInit->name);
+        return stmt;
+    }
+
+    if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        auto value = dynamic_cast<IntExpr*>(assign->expr);
+        if(value) known[assign->name] = value->value;
+        else known.erase(assign->name);
+        return stmt;
+    }
+
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        // a closed form loop only runs its body a few times
+        if(dynamic_cast<ClosedFormWhileStmt*>(stmt)){
+            forget(stmt, known);
+            return stmt;
+        }
+
+        // inner loops first, with what holds on every iteration
+        std::map<std::string, int> bodyKnown = known;
+        forget(whileStmt->body, bodyKnown);
+        whileStmt->body = visit(whileStmt->body, bodyKnown);
+
+        Stmt* result = unroll(whileStmt, known);
+        forget(result, known);
+        return result;
+    }
+
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        std::map<std::string, int> branchKnown = known;
+        ifStmt->thenStmt = visit(ifStmt->thenStmt, branchKnown);
+        if(ifStmt->elseStmt){
+            branchKnown = known;
+            ifStmt->elseStmt = visit(ifStmt->elseStmt, branchKnown);
+        }
+        forget(stmt, known);
+        return stmt;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        visitList(blockStmt->statements, known);
+        return stmt;
+    }
+
+    return stmt;
+}
+
+} // namespace
+
+void unrollLoops(std::vector<Stmt*>& stmts){
+    std::map<std::string, int> known;
+    visitList(stmts, known);
+}
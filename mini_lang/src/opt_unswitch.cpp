@@ -0,0 +1,150 @@
+// loop unswitching.
+// an if statement inside a while loop whose condition only reads variables the loop never
+// writes takes the same branch on every iteration. the test is moved in front of the loop
+// and the loop is duplicated, one copy per branch:
+//
+//   while (i < n) {                    if (mode == 1)
+//       if (mode == 1) s = s + i;          while (i < n) { s = s + i; i = i + 1; }
+//       else s = s - i;                else
+//       i = i + 1;                         while (i < n) { s = s - i; i = i + 1; }
+//   }
+//
+// the condition is now evaluated even when the loop body never runs, so like a hoisted
+// expression it must not be able to throw (see opt_licm.cpp). every copy costs the size of
+// the whole loop, a loop stops being unswitched once it has grown by more than
+// optOptions.unswitchBudget nodes (--unswitch-budget=N).
+// inner loops go first, an if that is invariant in the outer loop too then moves further out.
+
+#include "optimize.hpp"
+
+namespace {
+
+struct Unswitcher {
+    const std::set<std::string>& assigned;     // written somewhere in the loop
+    const std::set<std::string>& declared;     // declared on entry to the loop
+
+    Unswitcher(const std::set<std::string>& a, const std::set<std::string>& d) : assigned(a), declared(d) {}
+
+    bool invariant(Expr* expr) const {
+        if(dynamic_cast<IntExpr*>(expr)) return true;
+
+        if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+            return !assigned.count(varExpr->name) && declared.count(varExpr->name);
+        }
+
+        if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+            if(binExpr->op == '/'){
+                auto divisor = dynamic_cast<IntExpr*>(binExpr->right);
+                if(!divisor || divisor->value == 0 || divisor->value == -1) return false;
+            }
+            return invariant(binExpr->left) && invariant(binExpr->right);
+        }
+
+        return false;
+    }
+
+    // the first if (in execution order) with an invariant condition, as the pointer that
+    // holds it. nested loops are not searched, their ifs were already moved out if they could.
+    // finds the same position in a copy of the loop.
+    Stmt** find(Stmt*& stmt) const {
+        if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+            if(invariant(ifStmt->condition)) return &stmt;
+            if(Stmt** found = find(ifStmt->thenStmt)) return found;
+            return ifStmt->elseStmt ? find(ifStmt->elseStmt) : nullptr;
+        }
+        if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+            for(Stmt*& s : blockStmt->statements){
+                if(Stmt** found = find(s)) return found;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// replaces the if at *where by one of its branches
+Expr* takeBranch(Stmt** where, bool thenBranch){
+    auto ifStmt = static_cast<IfStmt*>(*where);
+    Expr* condition = ifStmt->condition;
+    ifStmt->condition = nullptr;
+    if(thenBranch){
+        *where = ifStmt->thenStmt;
+        ifStmt->thenStmt = nullptr;
+    }else{
+        *where = ifStmt->elseStmt ? ifStmt->elseStmt : new BlockStmt({});
+        ifStmt->elseStmt = nullptr;
+    }
+    delete ifStmt;
+    return condition;
+}
+
+// unswitches loop as long as it has an invariant if and the copies fit into budget
+Stmt* unswitch(WhileStmt* loop, const std::set<std::string>& declared, int& budget){
+    std::set<std::string> assigned;
+    collectAssigned(loop->body, assigned);
+    Unswitcher unswitcher(assigned, declared);
+
+    Stmt** where = unswitcher.find(loop->body);
+    int size = stmtSize(loop);
+    if(!where || size > budget) return loop;
+    budget -= size;
+
+    auto copy = static_cast<WhileStmt*>(cloneStmt(loop));
+    Expr* condition = takeBranch(where, true);
+    delete takeBranch(unswitcher.find(copy->body), false);
+    optStats.loopsUnswitched++;
+
+    // the rest of the budget is shared by both copies, the then branch asks first
+    Stmt* thenLoop = unswitch(loop, declared, budget);
+    Stmt* elseLoop = unswitch(copy, declared, budget);
+    return new IfStmt(condition, thenLoop, elseLoop);
+}
+
+Stmt* visit(Stmt* stmt, std::set<std::string>& declared);
+
+void visitList(std::vector<Stmt*>& stmts, std::set<std::string>& declared){
+    for(Stmt*& s : stmts){
+        s = visit(s, declared);
+    }
+}
+
+Stmt* visit(Stmt* stmt, std::set<std::string>& declared){
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        if(dynamic_cast<ClosedFormWhileStmt*>(stmt)){
+            noteReads(whileStmt->condition, declared);
+            return stmt;
+        }
+
+        std::set<std::string> bodyDeclared = declared;
+        noteReads(whileStmt->condition, bodyDeclared);
+        whileStmt->body = visit(whileStmt->body, bodyDeclared);
+
+        int budget = optOptions.unswitchBudget;
+        Stmt* result = unswitch(whileStmt, declared, budget);
+        noteReads(whileStmt->condition, declared);
+        return result;
+    }
+
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        noteReads(ifStmt->condition, declared);
+        std::set<std::string> elseDeclared = declared;
+        ifStmt->thenStmt = visit(ifStmt->thenStmt, declared);
+        if(ifStmt->elseStmt) ifStmt->elseStmt = visit(ifStmt->elseStmt, elseDeclared);
+        declared = intersect(declared, elseDeclared);
+        return stmt;
+    }
+
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        visitList(blockStmt->statements, declared);
+        return stmt;
+    }
+
+    stepDeclared(stmt, declared);
+    return stmt;
+}
+
+} // namespace
+
+void unswitchLoops(std::vector<Stmt*>& stmts){
+    std::set<std::string> declared;
+    visitList(stmts, declared);
+}
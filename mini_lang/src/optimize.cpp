@@ -0,0 +1,309 @@
+// driver for the optimization passes. each pass lives in its own opt_*.cpp file,
+// this file decides the order they run in and holds the helpers they share.
+
+#include "optimize.hpp"
+#include<climits>
+#include<iostream>
+
+OptStats optStats;
+OptOptions optOptions;
+
+bool foldBinary(char op, int l, int r, int& result){
+    // do + - * on unsigned so overflow wraps the same way the interpreter's int math does
+    unsigned ul = (unsigned)l;
+    unsigned ur = (unsigned)r;
+    switch(op){
+        case '+': result = (int)(ul + ur); return true;
+        case '-':
+        case 'n': result = (int)(ul - ur); return true;
+        case '*': result = (int)(ul * ur); return true;
+        case '/':
+            if(r == 0 || (l == INT_MIN && r == -1)) return false;
+            result = l / r;
+            return true;
+        case 'E': result = l == r ? 1 : 0; return true;
+        case 'N': result = l != r ? 1 : 0; return true;
+        case '<': result = l < r ? 1 : 0; return true;
+        case '>': result = l > r ? 1 : 0; return true;
+        case 'L': result = l <= r ? 1 : 0; return true;
+        case 'G': result = l >= r ? 1 : 0; return true;
+        default: return false;
+    }
+}
+
+bool sameExpr(Expr* a, Expr* b){
+    if(auto ia = dynamic_cast<IntExpr*>(a)){
+        auto ib = dynamic_cast<IntExpr*>(b);
+        return ib && ia->value == ib->value;
+    }
+    if(auto va = dynamic_cast<VarExpr*>(a)){
+        auto vb = dynamic_cast<VarExpr*>(b);
+        return vb && va->name == vb->name;
+    }
+    if(auto ba = dynamic_cast<BinaryExpr*>(a)){
+        auto bb = dynamic_cast<BinaryExpr*>(b);
+        return bb && ba->op == bb->op && sameExpr(ba->left, bb->left) && sameExpr(ba->right, bb->right);
+    }
+    if(auto ta = dynamic_cast<TempExpr*>(a)){
+        auto tb = dynamic_cast<TempExpr*>(b);
+        return tb && ta->slot == tb->slot;
+    }
+    if(auto sa = dynamic_cast<SelectExpr*>(a)){
+        auto sb = dynamic_cast<SelectExpr*>(b);
+        return sb && sameExpr(sa->condition, sb->condition) && sameExpr(sa->ifTrue, sb->ifTrue)
+                  && sameExpr(sa->ifFalse, sb->ifFalse);
+    }
+    return false;
+}
+
+bool inductionStep(Expr* expr, const std::string& name, int& step){
+    auto binExpr = dynamic_cast<BinaryExpr*>(expr);
+    if(!binExpr || (binExpr->op != '+' && binExpr->op != '-')) return false;
+
+    auto isName = [&name](Expr* e){
+        auto varExpr = dynamic_cast<VarExpr*>(e);
+        return varExpr && varExpr->name == name;
+    };
+    auto left = dynamic_cast<IntExpr*>(binExpr->left);
+    auto right = dynamic_cast<IntExpr*>(binExpr->right);
+    if(isName(binExpr->left) && right){
+        step = binExpr->op == '+' ? right->value : (int)(0u - (unsigned)right->value);
+        return true;
+    }
+    if(binExpr->op == '+' && left && isName(binExpr->right)){
+        step = left->value;
+        return true;
+    }
+    return false;
+}
+
+void collectAssigned(Stmt* stmt, std::set<std::string>& names){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+        names.insert(decl->name);
+    }else if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        names.insert(declInit->name);
+    }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        names.insert(assign->name);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        collectAssigned(ifStmt->thenStmt, names);
+        if(ifStmt->elseStmt) collectAssigned(ifStmt->elseStmt, names);
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        collectAssigned(whileStmt->body, names);
+    }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        for(Stmt* s : blockStmt->statements){
+            collectAssigned(s, names);
+        }
+    }
+}
+
+Expr* cloneExpr(Expr* expr){
+    if(auto intExpr = dynamic_cast<IntExpr*>(expr)){
+        return new IntExpr(intExpr->value);
+    }
+    if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+        auto copy = new VarExpr(varExpr->name);
+        copy->provenDeclared = varExpr->provenDeclared;
+        return copy;
+    }
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        auto copy = new BinaryExpr(binExpr->op, cloneExpr(binExpr->left), cloneExpr(binExpr->right));
+        copy->minValue = binExpr->minValue;
+        copy->maxValue = binExpr->maxValue;
+        copy->divisorNonZero = binExpr->divisorNonZero;
+        copy->lowered = binExpr->lowered;
+        return copy;
+    }
+    if(auto tempExpr = dynamic_cast<TempExpr*>(expr)){
+        return new TempExpr(tempExpr->slot);
+    }
+    if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+        return new TempStoreExpr(tempStore->slot, cloneExpr(tempStore->expr));
+    }
+    if(auto select = dynamic_cast<SelectExpr*>(expr)){
+        return new SelectExpr(cloneExpr(select->condition), cloneExpr(select->ifTrue), cloneExpr(select->ifFalse));
+    }
+    return nullptr;
+}
+
+Stmt* cloneStmt(Stmt* stmt){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+        return new VarDeclStmt(decl->name);
+    }
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        return new VarDeclInitStmt(declInit->name, cloneExpr(declInit->expr));
+    }
+    if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        auto copy = new AssignStmt(assign->name, cloneExpr(assign->expr));
+        copy->provenDeclared = assign->provenDeclared;
+        copy->steps = assign->steps;
+        return copy;
+    }
+    if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+        return new TempAssignStmt(tempAssign->slot, cloneExpr(tempAssign->expr));
+    }
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        return new IfStmt(cloneExpr(ifStmt->condition), cloneStmt(ifStmt->thenStmt),
+                          ifStmt->elseStmt ? cloneStmt(ifStmt->elseStmt) : nullptr);
+    }
+    if(auto closedForm = dynamic_cast<ClosedFormWhileStmt*>(stmt)){
+        auto copy = new ClosedFormWhileStmt(cloneExpr(closedForm->condition), cloneStmt(closedForm->body));
+        copy->counter = closedForm->counter;
+        copy->counterOnLeft = closedForm->counterOnLeft;
+        copy->cmp = closedForm->cmp;
+        copy->inductions = closedForm->inductions;
+        copy->steps = closedForm->steps;
+        copy->accumulators = closedForm->accumulators;
+        copy->derived = closedForm->derived;
+        copy->degree = closedForm->degree;
+        return copy;
+    }
+    if(auto doWhile = dynamic_cast<DoWhileStmt*>(stmt)){
+        return new DoWhileStmt(cloneExpr(doWhile->condition), cloneStmt(doWhile->body));
+    }
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        return new WhileStmt(cloneExpr(whileStmt->condition), cloneStmt(whileStmt->body));
+    }
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        std::vector<Stmt*> stmts;
+        for(Stmt* s : blockStmt->statements){
+            stmts.push_back(cloneStmt(s));
+        }
+        return new BlockStmt(stmts);
+    }
+    return nullptr;
+}
+
+int exprSize(Expr* expr){
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        return 1 + exprSize(binExpr->left) + exprSize(binExpr->right);
+    }
+    if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+        return 1 + exprSize(tempStore->expr);
+    }
+    if(auto select = dynamic_cast<SelectExpr*>(expr)){
+        return 1 + exprSize(select->condition) + exprSize(select->ifTrue) + exprSize(select->ifFalse);
+    }
+    return 1;
+}
+
+int stmtSize(Stmt* stmt){
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        return 1 + exprSize(declInit->expr);
+    }
+    if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        return 1 + exprSize(assign->expr);
+    }
+    if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+        return 1 + exprSize(tempAssign->expr);
+    }
+    if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        return 1 + exprSize(ifStmt->condition) + stmtSize(ifStmt->thenStmt)
+                 + (ifStmt->elseStmt ? stmtSize(ifStmt->elseStmt) : 0);
+    }
+    if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        return 1 + exprSize(whileStmt->condition) + stmtSize(whileStmt->body);
+    }
+    if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        int size = 1;
+        for(Stmt* s : blockStmt->statements){
+            size += stmtSize(s);
+        }
+        return size;
+    }
+    return 1;
+}
+
+void noteReads(Expr* expr, std::set<std::string>& declared){
+    if(auto varExpr = dynamic_cast<VarExpr*>(expr)){
+        declared.insert(varExpr->name);
+    }else if(auto binExpr = dynamic_cast<BinaryExpr*>(expr)){
+        noteReads(binExpr->left, declared);
+        noteReads(binExpr->right, declared);
+    }else if(auto tempStore = dynamic_cast<TempStoreExpr*>(expr)){
+        noteReads(tempStore->expr, declared);
+    }else if(auto select = dynamic_cast<SelectExpr*>(expr)){
+        noteReads(select->condition, declared);
+        noteReads(select->ifTrue, declared);
+        noteReads(select->ifFalse, declared);
+    }
+}
+
+std::set<std::string> intersect(const std::set<std::string>& a, const std::set<std::string>& b){
+    std::set<std::string> r;
+    for(const std::string& name : a){
+        if(b.count(name)) r.insert(name);
+    }
+    return r;
+}
+
+void stepDeclared(Stmt* stmt, std::set<std::string>& declared){
+    if(auto decl = dynamic_cast<VarDeclStmt*>(stmt)){
+        declared.insert(decl->name);
+    }else if(auto declInit = dynamic_cast<VarDeclInitStmt*>(stmt)){
+        noteReads(declInit->expr, declared);
+        declared.insert(declInit->name);
+    }else if(auto assign = dynamic_cast<AssignStmt*>(stmt)){
+        // the target is checked before the value is computed, either way both exist after
+        declared.insert(assign->name);
+        noteReads(assign->expr, declared);
+    }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(stmt)){
+        noteReads(tempAssign->expr, declared);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        noteReads(ifStmt->condition, declared);
+        std::set<std::string> elseDeclared = declared;
+        stepDeclared(ifStmt->thenStmt, declared);
+        if(ifStmt->elseStmt) stepDeclared(ifStmt->elseStmt, elseDeclared);
+        declared = intersect(declared, elseDeclared);
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        // the body may run zero times, only the condition is evaluated for sure
+        noteReads(whileStmt->condition, declared);
+    }else if(auto blockStmt = dynamic_cast<BlockStmt*>(stmt)){
+        for(Stmt* s : blockStmt->statements){
+            stepDeclared(s, declared);
+        }
+    }
+}
+
+void printOptStats(){
+    std::cout<<"\n---- Optimizer Stats ----\n";
+    std::cout<<"constants folded: "<<optStats.constantsFolded<<"\n";
+    std::cout<<"branches removed: "<<optStats.branchesRemoved<<"\n";
+    std::cout<<"loops removed: "<<optStats.loopsRemoved<<"\n";
+    std::cout<<"loops unswitched: "<<optStats.loopsUnswitched<<"\n";
+    std::cout<<"expressions hoisted: "<<optStats.expressionsHoisted<<"\n";
+    std::cout<<"induction expressions reduced: "<<optStats.inductionsReduced<<"\n";
+    std::cout<<"loops unrolled: "<<optStats.loopsUnrolled<<"\n";
+    std::cout<<"loops partially unrolled: "<<optStats.loopsPartiallyUnrolled<<"\n";
+    std::cout<<"loops in closed form: "<<optStats.loopsClosedForm<<"\n";
+    std::cout<<"evaluations eliminated: "<<optStats.evaluationsEliminated<<"\n";
+    std::cout<<"stores eliminated: "<<optStats.storesEliminated<<"\n";
+    std::cout<<"strength reduced: "<<optStats.strengthReduced<<"\n";
+    std::cout<<"ifs converted to selects: "<<optStats.ifsConverted<<"\n";
+    std::cout<<"loops rotated: "<<optStats.loopsRotated<<"\n";
+    std::cout<<"division checks removed: "<<optStats.divisionChecksRemoved<<"\n";
+    std::cout<<"declaration checks removed: "<<optStats.checksRemoved<<"\n";
+}
+
+void optimizeProgram(std::vector<Stmt*>& stmts){
+    propagateConstants(stmts);
+    // before the closed form pass: a loop without its if may have a closed form
+    unswitchLoops(stmts);
+    evaluateClosedFormLoops(stmts);
+    hoistLoopInvariants(stmts);
+    reduceInductionVariables(stmts);
+    // after the loop passes that want a single copy of the body, before the ones that
+    // profit from longer straight runs
+    unrollLoops(stmts);
+    eliminateDeadStores(stmts);
+    eliminateCommonSubexpressions(stmts);
+    reduceStrength(stmts);
+    if(optOptions.ifConvert){
+        convertIfs(stmts);
+    }
+    // after everything that changes values, so the ranges describe the tree that runs
+    analyzeRanges(stmts);
+    // the loop shape is the last thing to change, the passes above only know while loops
+    if(optOptions.rotateLoops){
+        rotateLoops(stmts);
+    }
+}
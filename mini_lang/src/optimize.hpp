@@ -0,0 +1,128 @@
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+// optimization passes over the parsed program.
+// every pass rewrites the tree in place and must leave the observable behaviour unchanged:
+// the final symbol table and the first runtime error (if any) are exactly what the
+// unoptimized program would produce.
+
+#include "ast.hpp"
+#include<set>
+#include<string>
+#include<vector>
+
+// counters filled in by the passes
+struct OptStats {
+    int constantsFolded = 0;    // variable reads / expressions replaced by a literal
+    int branchesRemoved = 0;    // if statements whose condition folded to a constant
+    int loopsRemoved = 0;       // while loops whose condition is false on entry
+    int loopsUnswitched = 0;    // loops duplicated to move an invariant if out of them
+    int expressionsHoisted = 0; // loop invariant expressions moved in front of their loop
+    int inductionsReduced = 0;  // products of induction variables replaced by stepped temporaries
+    int loopsUnrolled = 0;      // loops replaced by copies of their body
+    int loopsPartiallyUnrolled = 0; // loops running several copies of their body per test
+    int loopsClosedForm = 0;    // counting loops replaced by their closed form
+    int evaluationsEliminated = 0;  // repeated expressions replaced by an earlier result
+    int storesEliminated = 0;   // assignments overwritten before anything read them
+    int checksRemoved = 0;      // variable uses proven declared, checked at no runtime cost
+    int divisionChecksRemoved = 0;  // divisions whose divisor can never be 0
+    int strengthReduced = 0;    // * and / by a literal lowered to shifts / multiply-high
+    int ifsConverted = 0;       // ifs turned into a branchless select
+    int loopsRotated = 0;       // while loops turned into a guarded do-while
+};
+
+extern OptStats optStats;
+
+// limits for the passes that trade code size for speed, set from the command line
+struct OptOptions {
+    int unswitchBudget = 200;   // nodes a loop may grow by through unswitching
+    int unrollFactor = 4;       // copies of the body per test in partially unrolled loops, < 2 turns it off
+    bool ifConvert = false;     // turn small ifs into selects, off by default (see opt_ifconv.cpp)
+    bool rotateLoops = false;   // turn while loops into guarded do-whiles (see opt_rotate.cpp)
+};
+
+extern OptOptions optOptions;
+
+void printOptStats();   // --stats
+
+// runs every pass in order
+void optimizeProgram(std::vector<Stmt*>& stmts);
+
+// computes "l op r" exactly like evalExpr does (wrapping on overflow).
+// returns false when the operation would throw or trap at runtime (x/0, INT_MIN/-1)
+bool foldBinary(char op, int l, int r, int& result);
+
+// structural equality of two expression trees
+bool sameExpr(Expr* a, Expr* b);
+
+// step of "name = name + c" / "name = name - c" (c a literal), false if expr is not of that form
+bool inductionStep(Expr* expr, const std::string& name, int& step);
+
+// names written (declared or assigned) anywhere inside stmt
+void collectAssigned(Stmt* stmt, std::set<std::string>& names);
+
+// deep copies, for passes that duplicate code. symbol table slots are looked up again,
+// everything the optimizer attached to the nodes is kept
+Expr* cloneExpr(Expr* expr);
+Stmt* cloneStmt(Stmt* stmt);
+
+// number of nodes in a tree, the measure of code size for passes that duplicate code
+int exprSize(Expr* expr);
+int stmtSize(Stmt* stmt);
+
+// definite declaration tracking: "declared" holds the variables that are in the symbol
+// table on every path reaching the current point. noteReads adds the variables an
+// expression reads (if it evaluated without error they must exist), stepDeclared moves
+// the set past a whole statement.
+void noteReads(Expr* expr, std::set<std::string>& declared);
+void stepDeclared(Stmt* stmt, std::set<std::string>& declared);
+std::set<std::string> intersect(const std::set<std::string>& a, const std::set<std::string>& b);
+
+// sparse conditional constant propagation + dead branch elimination (opt_constprop.cpp)
+void propagateConstants(std::vector<Stmt*>& stmts);
+
+// closed form evaluation of induction variable loops (opt_scev.cpp)
+void evaluateClosedFormLoops(std::vector<Stmt*>& stmts);
+
+// loop unswitching: invariant ifs move out of while loops (opt_unswitch.cpp)
+void unswitchLoops(std::vector<Stmt*>& stmts);
+
+// loop invariant code motion for while loops (opt_licm.cpp)
+void hoistLoopInvariants(std::vector<Stmt*>& stmts);
+
+// induction variable strength reduction (opt_ivsr.cpp)
+void reduceInductionVariables(std::vector<Stmt*>& stmts);
+
+// unrolling of counting loops with a literal bound (opt_unroll.cpp)
+void unrollLoops(std::vector<Stmt*>& stmts);
+
+// dead store elimination (opt_dse.cpp)
+void eliminateDeadStores(std::vector<Stmt*>& stmts);
+
+// local value numbering / common subexpression elimination (opt_cse.cpp)
+void eliminateCommonSubexpressions(std::vector<Stmt*>& stmts);
+
+// strength reduction of * and / by literals (opt_strength.cpp).
+// lowerMultiply / lowerDivide fill in how to compute x * factor / x / divisor, and return
+// false when the constant is not worth it (or can not be lowered without changing an error)
+void reduceStrength(std::vector<Stmt*>& stmts);
+bool lowerMultiply(int factor, ConstArith& out);
+bool lowerDivide(int divisor, ConstArith& out);
+
+// if-conversion: ifs that only pick the value of one variable become a SelectExpr
+// (opt_ifconv.cpp)
+void convertIfs(std::vector<Stmt*>& stmts);
+
+// value range analysis (opt_range.cpp). annotates every BinaryExpr with the range of its
+// result and drops the zero check of divisions that can not divide by 0
+void analyzeRanges(std::vector<Stmt*>& stmts);
+
+// loop rotation: while loops become a guard and a DoWhileStmt (opt_rotate.cpp)
+void rotateLoops(std::vector<Stmt*>& stmts);
+
+// definite declaration analysis (opt_declared.cpp). marks the variable uses that can not
+// fail their "is it declared" check and warns about the others on stderr.
+// not part of optimizeProgram: it runs on whatever tree is going to be executed
+void checkDeclarations(std::vector<Stmt*>& stmts);
+
+#endif
@@ -0,0 +1,124 @@
+// parallel lexing (see parlex.hpp).
+// the chunks are cut right after a newline, roughly size / threads bytes apart:
+//
+//   |var a = 1;\nwhile (a < 9) {\n  a = a + 1; // step\n}\n|
+//    ^ chunk 0                  ^ chunk 1              ^ chunk 2
+//
+// a cut never falls inside a token. identifiers, numbers and operators have no newline in
+// them, and a // comment runs up to the newline but not over it. so a scanner starting at
+// the beginning of a chunk reads the same tokens as one that started at the beginning of
+// the file. every thread owns its Scanner and its token array, nothing is shared while
+// they run. unknown characters are kept in the arrays and printed when the parser gets
+// to them, where the flex scanner prints them.
+
+#include "parlex.hpp"
+#include<cstring>
+#include<string>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<thread>
+#include<unistd.h>
+
+namespace {
+
+const char* input = nullptr;
+size_t inputLength = 0;
+std::string readInput;  // pipes and terminals can not be mapped
+
+std::vector<std::vector<Token>> chunks;
+size_t chunk = 0;       // the next token the parser gets
+size_t next = 0;
+
+// the file's pages followed by zero pages: reserve the whole range, then put the file over
+// the start of it. past the end of the file the last page of the file reads as zeros too
+bool mapFile(int fd, size_t size){
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t reserved = (size + scanPadding + page - 1) / page * page;
+    void* area = mmap(nullptr, reserved, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(area == MAP_FAILED) return false;
+    if(mmap(area, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED){
+        munmap(area, reserved);
+        return false;
+    }
+    input = (const char*)area;
+    inputLength = size;
+    return true;
+}
+
+void lexChunk(const char* begin, const char* end, std::vector<Token>& tokens){
+    Scanner s = { begin, end };
+    Token token;
+    // about one token per 5 bytes in typical code
+    tokens.reserve((end - begin) / 5 + 16);
+    for(scanToken(s, token); token.kind != 0; scanToken(s, token)){
+        tokens.push_back(token);
+    }
+}
+
+} // namespace
+
+bool mapInput(FILE* in){
+    int fd = fileno(in);
+    struct stat info;
+    if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 && mapFile(fd, info.st_size)){
+        return true;
+    }
+    char buffer[65536];
+    size_t n;
+    while((n = fread(buffer, 1, sizeof(buffer), in)) > 0){
+        readInput.append(buffer, n);
+    }
+    if(ferror(in)) return false;
+    inputLength = readInput.size();
+    readInput.append(scanPadding, '\0');
+    input = readInput.data();
+    return true;
+}
+
+const char* inputText(){
+    return input;
+}
+
+size_t inputSize(){
+    return inputLength;
+}
+
+void lexInParallel(const char* text, size_t size, int threads){
+    if(threads < 1) threads = 1;
+    const char* end = text + size;
+    std::vector<const char*> cuts = { text };
+    for(int k = 1; k < threads; k++){
+        const char* target = text + size / threads * k;
+        if(target < cuts.back()) target = cuts.back();
+        const char* newline = (const char*)memchr(target, '\n', end - target);
+        if(!newline) break;
+        cuts.push_back(newline + 1);
+    }
+    cuts.push_back(end);
+
+    chunks.assign(cuts.size() - 1, std::vector<Token>());
+    std::vector<std::thread> workers;
+    for(size_t k = 1; k < chunks.size(); k++){
+        workers.emplace_back(lexChunk, cuts[k], cuts[k + 1], std::ref(chunks[k]));
+    }
+    lexChunk(cuts[0], cuts[1], chunks[0]);
+    for(std::thread& w : workers) w.join();
+    chunk = 0;
+    next = 0;
+}
+
+const std::vector<std::vector<Token>>& lexedChunks(){
+    return chunks;
+}
+
+int chunkLex(){
+    for(;;){
+        while(chunk < chunks.size() && next == chunks[chunk].size()){
+            chunk++;
+            next = 0;
+        }
+        if(chunk == chunks.size()) return 0;
+        int kind = parserToken(chunks[chunk][next++]);
+        if(kind != unknownToken) return kind;
+    }
+}
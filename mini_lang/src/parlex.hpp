@@ -0,0 +1,29 @@
+#ifndef PARLEX_HPP
+#define PARLEX_HPP
+
+// parallel lexing of large sources (parlex.cpp).
+// with --lex-threads=N the input is mapped into memory and cut into N chunks at newlines.
+// no token reaches over a newline (a // comment ends in front of it), so every chunk can
+// be scanned on its own. each chunk is scanned by its own thread into its own token array,
+// and the parser reads the arrays one after the other.
+
+#include "simdlex.hpp"
+#include<cstdio>
+#include<vector>
+
+// maps in (read if it is not a regular file) with scanPadding zero bytes after the end.
+// false if it can not be read
+bool mapInput(FILE* in);
+const char* inputText();
+size_t inputSize();
+
+// tokens of text[0, size) in up to threads chunks, scanned at once. scanPadding readable
+// bytes must follow the text, which has to stay valid while the tokens are read
+void lexInParallel(const char* text, size_t size, int threads);
+
+const std::vector<std::vector<Token>>& lexedChunks();
+
+// the parser's view of the chunks, in order
+int chunkLex();
+
+#endif
@@ -5,8 +5,19 @@
 %{
     #include<cstdio>
     #include<cstdlib>
+    #include<cstring>
     #include "ast.hpp"
+    #include "optimize.hpp"
+    #include "progcache.hpp"
+    #include "simdlex.hpp"
+    #include "parlex.hpp"
+    #include "tokstream.hpp"
+    #include "specparse.hpp"
+    #include "pratt.hpp"
+    #include "bytecode.hpp"
+    #include "lazyblock.hpp"
     #include <vector>
+    #include <string>
 
     std::vector<Stmt*> programStatements;
     void execStmt(Stmt* stmt);
@@ -14,13 +25,43 @@
     void printStmt(Stmt* stmt, int indent);
 
     int yylex();
-    void yyerror(const char *s);
+    // the parser asks nextToken(), which picks the flex scanner, the one in simdlex.cpp, the
+    // tokens parlex.cpp scanned in parallel, a token stream saved earlier, the piece of
+    // tokens a parallel parser works on or the source of a lazy parse
+    int nextToken(union YYSTYPE* lval, ParseContext& context);
+    #define yylex nextToken
+    void yyerror(ParseContext& context, const char *s);
+    extern FILE* yyin;
 
     // forward declarations for union
     struct Expr;
     struct Stmt;
+
+    // what the binary operator rules make: a node, or with context.code just the operator's
+    // code after that of the operands
+    static Expr* binary(ParseContext& context, char op, Expr* left, Expr* right){
+        if(context.code){
+            emitOperator(*context.code, op);
+            return nullptr;
+        }
+        return makeBinaryExpr(op, left, right);
+    }
 %}
 
+// pure, so several parsers can run at once (specparse.cpp). the scanners still set the
+// global yylval, nextToken copies it
+%define api.pure full
+%parse-param {ParseContext& context}
+%lex-param {ParseContext& context}
+
+%code requires {
+    struct ParseContext;
+}
+
+%code provides {
+    extern YYSTYPE yylval;
+}
+
 %union {
     int ival;
     char* sval;
@@ -41,9 +82,11 @@
 
 %token <ival> INTEGER
 %token <sval> IDENTIFIER
+%token <stmt> LAZYBLOCK     // a whole block: not parsed yet (lazyblock.cpp) or kept (reparse.cpp)
 
 %type <stmt> statement variable_decl assignment if_statement while_statement block
 %type <stmt_list> block_statements 
+%type <ival> jump_if_false jump label
 %type <expr> expression equality comparision term factor primary unary
 
 %%
@@ -53,7 +96,11 @@ program:
 
 statement_list:
     statement_list statement{
-        programStatements.push_back($2);
+        if(context.code){
+            context.code->complete = context.code->words.size();
+        }else{
+            context.statements->push_back($2);
+        }
     }
     |
     ;
@@ -76,54 +123,118 @@ statement:
         }
     ;
 
+// with context.code every action emits code (bytecode.cpp) and the values are nullptr
 variable_decl:
     VAR IDENTIFIER SEMICOLON {
-        $$ = new VarDeclStmt($2);
+        if(context.code){
+            emitVariable(*context.code, OpDeclare, $2);
+            $$ = nullptr;
+        }else{
+            $$ = hashed(new VarDeclStmt($2));
+        }
         free($2);
     }
     | VAR IDENTIFIER ASSIGN expression SEMICOLON {
-        $$ = new VarDeclInitStmt($2,$4);
+        if(context.code){
+            emitVariable(*context.code, OpDeclareStore, $2);
+            $$ = nullptr;
+        }else{
+            $$ = hashed(new VarDeclInitStmt($2,$4));
+        }
         free($2);
     }
     ;
 
 assignment:
-    IDENTIFIER ASSIGN expression SEMICOLON {
-        $$ = new AssignStmt($1, $3);
+    IDENTIFIER ASSIGN {
+        // execStmt checks the target before it evaluates the value
+        if(context.code) emitVariable(*context.code, OpCheckAssign, $1);
+    } expression SEMICOLON {
+        if(context.code){
+            emitVariable(*context.code, OpStore, $1);
+            $$ = nullptr;
+        }else{
+            $$ = hashed(new AssignStmt($1, $4));
+        }
         free($1);
     }
     ;
 
+// empty rules that mark where a jump goes in the code, -1 without context.code. they are
+// whole rules rather than actions in the middle of the if rules, which would be two
+// different empty rules reducing at the same point
+jump_if_false:
+    {
+        $$ = context.code ? emitJump(*context.code, OpJumpIfFalse) : -1;
+    }
+    ;
+
+jump:
+    {
+        $$ = context.code ? emitJump(*context.code, OpJump) : -1;
+    }
+    ;
+
+label:
+    {
+        $$ = context.code ? here(*context.code) : -1;
+    }
+    ;
+
 if_statement:
-    IF LPAREN expression RPAREN statement {
-        $$ = new IfStmt($3,$5);
+    IF LPAREN expression RPAREN jump_if_false statement {
+        if(context.code){
+            patchJump(*context.code, $5, here(*context.code));
+            $$ = nullptr;
+        }else{
+            $$ = hashed(new IfStmt($3,$6));
+        }
     }
-    | IF LPAREN expression RPAREN statement ELSE statement {
-        $$ = new IfStmt($3,$5,$7);
+    | IF LPAREN expression RPAREN jump_if_false statement ELSE jump statement {
+        if(context.code){
+            patchJump(*context.code, $5, $8 + 1);
+            patchJump(*context.code, $8, here(*context.code));
+            $$ = nullptr;
+        }else{
+            $$ = hashed(new IfStmt($3,$6,$9));
+        }
     }
     ;
 
 while_statement:
-    WHILE LPAREN expression RPAREN statement{
-        $$ = new WhileStmt($3, $5);
+    WHILE label LPAREN expression RPAREN jump_if_false statement{
+        if(context.code){
+            emit(*context.code, OpJump, $2);
+            patchJump(*context.code, $6, here(*context.code));
+            $$ = nullptr;
+        }else{
+            $$ = hashed(new WhileStmt($4, $7));
+        }
     }
     ;
 
 block:
     LBRACE block_statements RBRACE {
-        $$ = new BlockStmt(*$2);
+        if(context.code){
+            $$ = nullptr;
+        }else{
+            $$ = hashed(new BlockStmt(*$2));
+        }
 
         delete $2;
     }
+    | LAZYBLOCK {
+        $$ = $1;
+    }
     ;
 
 block_statements:
     block_statements statement {
         $$ = $1;
-        $$->push_back($2);
+        if($$) $$->push_back($2);
     }
     |{
-        $$ = new std::vector<Stmt*>();
+        $$ = context.code ? nullptr : new std::vector<Stmt*>();
     }
     ;
 
@@ -135,10 +246,10 @@ expression:
 
 equality:
     equality EQ comparision {
-        $$ = new BinaryExpr('E',$1,$3);
+        $$ = binary(context, 'E',$1,$3);
     }
     | equality NEQ comparision {
-        $$ = new BinaryExpr('N',$1,$3);
+        $$ = binary(context, 'N',$1,$3);
     }
     | comparision {
         $$ = $1;
@@ -147,17 +258,17 @@ equality:
 
 comparision:
     comparision LT term{
-        $$ = new BinaryExpr('<',$1,$3);
+        $$ = binary(context, '<',$1,$3);
     }
     | comparision GT term {
-        $$ = new BinaryExpr('>',$1,$3);
+        $$ = binary(context, '>',$1,$3);
     }
     | comparision LE term {
-        $$ = new BinaryExpr('L', $1, $3);
+        $$ = binary(context, 'L', $1, $3);
 
     }
     | comparision GE term {
-        $$ = new BinaryExpr('G',$1,$3);
+        $$ = binary(context, 'G',$1,$3);
     }
     | term {
         $$ = $1;
@@ -167,10 +278,10 @@ comparision:
 
 term:
         term PLUS factor {
-            $$ = new BinaryExpr('+', $1, $3);
+            $$ = binary(context, '+', $1, $3);
         }
     |   term MINUS factor {
-            $$ = new BinaryExpr('-',$1, $3);
+            $$ = binary(context, '-',$1, $3);
         }
     |   factor {
             $$ =$1;
@@ -181,10 +292,10 @@ term:
 
 factor:
         factor MUL unary {
-            $$ = new BinaryExpr('*', $1, $3);
+            $$ = binary(context, '*', $1, $3);
         }
     |   factor DIV unary {
-            $$ = new BinaryExpr('/',$1, $3);
+            $$ = binary(context, '/',$1, $3);
         }
     |   unary {
             $$ =$1;
@@ -198,7 +309,12 @@ unary:
         $$ = $2;
     }
     | MINUS unary {
-        $$ = new BinaryExpr('n', new IntExpr(0), $2);
+        if(context.code){
+            emit(*context.code, OpNegate);
+            $$ = nullptr;
+        }else{
+            $$ = makeBinaryExpr('n', makeIntExpr(0), $2);
+        }
     }
     | primary {
         $$ = $1;
@@ -207,10 +323,20 @@ unary:
 
 primary:
     INTEGER{
-        $$ = new IntExpr($1);
+        if(context.code){
+            emit(*context.code, OpPush, $1);
+            $$ = nullptr;
+        }else{
+            $$ = makeIntExpr($1);
+        }
     }
     | IDENTIFIER {
-        $$ = new VarExpr($1);
+        if(context.code){
+            emitVariable(*context.code, OpLoad, $1);
+            $$ = nullptr;
+        }else{
+            $$ = makeVarExpr($1);
+        }
         free($1);
     }
     | LPAREN expression RPAREN {
@@ -221,19 +347,336 @@ primary:
 
 %%
 
-void yyerror(const char *s){
-    printf("Syntax error: %s\n",s);
+YYSTYPE yylval;
+
+void yyerror(ParseContext& context, const char *s){
+    if(!context.quiet) printf("Syntax error: %s\n",s);
+}
+
+bool simdLexer = false;  // --simd-lexer tokenizes with simdlex.cpp instead of flex
+int lexThreads = 0;      // --lex-threads=N tokenizes the whole input first, in N chunks at once
+bool replayTokens = false;  // --load-tokens=FILE parses a saved token stream
+
+int parseThreads = 0;    // --parse-threads=N parses top-level statements on N threads
+
+#undef yylex
+int nextToken(YYSTYPE* lval, ParseContext& context){
+    if(context.source){
+        Token t;
+        do{
+            scanToken(*context.source, t);
+        }while(parserToken(t) == unknownToken);
+        const char* begin;
+        const char* end;
+        if(t.kind == LBRACE && matchBlock(*context.source, begin, end)){
+            lval->stmt = hashed(new LazyBlockStmt(begin, end));
+            return LAZYBLOCK;
+        }
+        *lval = yylval;
+        return t.kind;
+    }
+    if(context.next){
+        if(context.next == context.end) return 0;
+        const Token& t = *context.next++;
+        if(t.kind == INTEGER) lval->ival = t.value;
+        if(t.kind == IDENTIFIER) lval->sval = strndup(t.text, t.length);
+        if(t.kind == LAZYBLOCK) lval->stmt = context.blocks[t.value];
+        return t.kind;
+    }
+    int kind;
+    if(replayTokens){
+        kind = replayLex();
+    }else if(lexThreads > 0){
+        kind = chunkLex();
+    }else{
+        kind = simdLexer ? simdLex() : yylex();
+    }
+    *lval = yylval;
+    return kind;
 }
 
-int main(){
+// "--name=N" with N a non-negative number. returns false if arg is some other option,
+// exits on a bad number
+bool intOption(const std::string& arg, const std::string& name, int& value){
+    if(arg.compare(0, name.size() + 1, name + "=") != 0) return false;
+    const char* text = arg.c_str() + name.size() + 1;
+    char* end;
+    long v = strtol(text, &end, 10);
+    if(*text == '\0' || *end != '\0' || v < 0 || v > 1000000000){
+        fprintf(stderr, "Invalid value for %s: %s\n", name.c_str(), text);
+        exit(1);
+    }
+    value = (int)v;
+    return true;
+}
+
+// "--name=text" with a non-empty text. returns false if arg is some other option
+bool stringOption(const std::string& arg, const std::string& name, std::string& value){
+    if(arg.compare(0, name.size() + 1, name + "=") != 0 || arg.size() == name.size() + 1) return false;
+    value = arg.substr(name.size() + 1);
+    return true;
+}
+
+int main(int argc, char** argv){
+    bool optimize = true;   // --no-opt runs the tree exactly as parsed
+    bool stats = false;     // --stats prints what the optimizer did
+    bool printHash = false; // --print-hash prints the merkle hash of the parsed program
+    bool singlePass = false;    // --single-pass compiles to bytecode while parsing, no tree
+    bool lazyBlocks = false;    // --lazy-blocks parses a block when it first runs
+    std::string cacheDir;   // --cache-dir=DIR keeps compiled programs between runs
+    std::string emitAstBin; // --emit-ast-bin=FILE writes the program that runs as a binary ast
+    std::string runAstBin;  // --run-ast-bin=FILE runs a binary ast instead of reading a program
+    std::string saveTokens; // --save-tokens=FILE writes the tokens of the input
+    std::string loadTokens; // --load-tokens=FILE parses saved tokens instead of reading the input
+    std::string parser = "bison";   // --parser=pratt parses with the hand-written parser
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--no-opt"){
+            optimize = false;
+        }else if(arg == "--stats"){
+            stats = true;
+        }else if(arg == "--print-hash"){
+            printHash = true;
+        }else if(arg == "--hash-cons"){
+            enableHashConsing();
+        }else if(arg == "--if-convert"){
+            optOptions.ifConvert = true;
+        }else if(arg == "--rotate-loops"){
+            optOptions.rotateLoops = true;
+        }else if(arg == "--simd-lexer"){
+            simdLexer = true;
+        }else if(arg == "--single-pass"){
+            singlePass = true;
+        }else if(arg == "--lazy-blocks"){
+            lazyBlocks = true;
+        }else if(stringOption(arg, "--cache-dir", cacheDir)){
+        }else if(stringOption(arg, "--emit-ast-bin", emitAstBin)){
+        }else if(stringOption(arg, "--run-ast-bin", runAstBin)){
+        }else if(stringOption(arg, "--save-tokens", saveTokens)){
+        }else if(stringOption(arg, "--load-tokens", loadTokens)){
+        }else if(stringOption(arg, "--parser", parser)){
+            if(parser != "bison" && parser != "pratt"){
+                fprintf(stderr, "Unknown parser: %s\n", parser.c_str());
+                return 1;
+            }
+        }else if(intOption(arg, "--unswitch-budget", optOptions.unswitchBudget)){
+        }else if(intOption(arg, "--unroll-factor", optOptions.unrollFactor)){
+        }else if(intOption(arg, "--lex-threads", lexThreads)){
+        }else if(intOption(arg, "--parse-threads", parseThreads)){
+        }else{
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // nothing to parse: the nodes are read where the file is mapped. there is no front end
+    // and no tree, so none of the options for those can do anything
+    if(!runAstBin.empty()){
+        OptOptions defaults;
+        const char* other = singlePass ? "--single-pass"
+                          : lazyBlocks ? "--lazy-blocks"
+                          : parser == "pratt" ? "--parser=pratt"
+                          : simdLexer ? "--simd-lexer"
+                          : lexThreads > 0 ? "--lex-threads"
+                          : parseThreads > 0 ? "--parse-threads"
+                          : !saveTokens.empty() ? "--save-tokens"
+                          : !loadTokens.empty() ? "--load-tokens"
+                          : !cacheDir.empty() ? "--cache-dir"
+                          : !emitAstBin.empty() ? "--emit-ast-bin"
+                          : printHash ? "--print-hash"
+                          : hashConsingEnabled() ? "--hash-cons"
+                          : stats ? "--stats"
+                          : optOptions.ifConvert ? "--if-convert"
+                          : optOptions.rotateLoops ? "--rotate-loops"
+                          : optOptions.unswitchBudget != defaults.unswitchBudget ? "--unswitch-budget"
+                          : optOptions.unrollFactor != defaults.unrollFactor ? "--unroll-factor"
+                          : nullptr;
+        if(other){
+            fprintf(stderr, "--run-ast-bin can not be used with %s\n", other);
+            return 1;
+        }
+        if(!runAstBinary(runAstBin)) return 1;
+        printSymbolTable();
+        return 0;
+    }
+
+    // everything that works on the tree
+    if(singlePass){
+        const char* other = !cacheDir.empty() ? "--cache-dir"
+                          : !emitAstBin.empty() ? "--emit-ast-bin"
+                          : printHash ? "--print-hash"
+                          : parseThreads > 0 ? "--parse-threads"
+                          : parser == "pratt" ? "--parser=pratt"
+                          : nullptr;
+        if(other){
+            fprintf(stderr, "--single-pass can not be used with %s\n", other);
+            return 1;
+        }
+    }
+
+    // a lazy parse goes back to the source, which has to be in memory and whole. the tree
+    // has holes, so it runs as parsed
+    if(lazyBlocks){
+        const char* other = !cacheDir.empty() ? "--cache-dir"
+                          : !emitAstBin.empty() ? "--emit-ast-bin"
+                          : printHash ? "--print-hash"
+                          : singlePass ? "--single-pass"
+                          : parseThreads > 0 ? "--parse-threads"
+                          : lexThreads > 0 ? "--lex-threads"
+                          : !saveTokens.empty() ? "--save-tokens"
+                          : !loadTokens.empty() ? "--load-tokens"
+                          : nullptr;
+        if(other){
+            fprintf(stderr, "--lazy-blocks can not be used with %s\n", other);
+            return 1;
+        }
+        optimize = false;
+    }
+
+    // a token stream has no source to look up in the cache
+    if(!loadTokens.empty()){
+        if(!cacheDir.empty()){
+            fprintf(stderr, "--load-tokens can not be used with --cache-dir\n");
+            return 1;
+        }
+        if(!loadTokenStream(loadTokens)) return 1;
+        replayTokens = true;
+    }else if((!saveTokens.empty() || parseThreads > 0) && lexThreads == 0){
+        // the tokens to save or to parse in pieces come from the chunked scanner
+        lexThreads = 1;
+    }
+
+    // with a cache the whole source is read first, its hash decides whether to parse at all.
+    // the simd lexer scans it in memory too, the parallel one where it is mapped
+    std::string source;
+    Hash128 key;
+    CachedProgram cached;
+    bool cacheHit = false;
+    if(replayTokens){
+    }else if(lexThreads > 0){
+        if(!mapInput(stdin)){
+            fprintf(stderr, "Cannot read input\n");
+            return 1;
+        }
+        if(!cacheDir.empty()) source.assign(inputText(), inputSize());
+    }else if(!cacheDir.empty() || simdLexer || lazyBlocks){
+        char buffer[65536];
+        size_t n;
+        while((n = fread(buffer, 1, sizeof(buffer), stdin)) > 0){
+            source.append(buffer, n);
+        }
+    }
+    if(!cacheDir.empty()){
+        key = cacheKey(source, optimize);
+        cacheHit = loadCachedProgram(cacheDir, key, cached);
+        if(!source.empty() && !simdLexer && lexThreads == 0) yyin = fmemopen(&source[0], source.size(), "r");
+    }
+    if(replayTokens){
+    }else if(lexThreads > 0){
+        if(!cacheHit || !saveTokens.empty()) lexInParallel(inputText(), inputSize(), lexThreads);
+        if(!saveTokens.empty() && !writeTokenStream(saveTokens, inputText(), inputSize(), lexedChunks())){
+            fprintf(stderr, "Cannot write %s\n", saveTokens.c_str());
+            return 1;
+        }
+    }else if(simdLexer){
+        setScannerSource(source);
+    }
+    std::string lazySource;
+    Scanner lazyScanner = { nullptr, nullptr };
+    if(lazyBlocks){
+        lazySource = source + std::string(scanPadding, '\0');
+        lazyScanner = Scanner{ lazySource.data(), lazySource.data() + source.size() };
+    }
+
     printf("Parsing started.......\n");
-    yyparse();
+
+    // nothing to print, optimize or keep: the code runs once and is gone. after a syntax
+    // error the statements before it run, as they do from the tree
+    if(singlePass){
+        Bytecode code;
+        ParseContext compiler;
+        compiler.code = &code;
+        yyparse(compiler);
+        code.words.resize(code.complete);
+        printf("Parsing finished.\n");
+
+        runBytecode(code);
+        printSymbolTable();
+        if(stats){
+            printBytecodeStats(code);
+        }
+        return 0;
+    }
+
+    bool parsed = true;
+    if(cacheHit){
+        programStatements = cached.program;
+    }else{
+        // the hash-consing table is shared by all nodes, with it the parser runs alone
+        int (*parse)(ParseContext&) = parser == "pratt" ? prattParse : yyparse;
+        if(lazyBlocks){
+            enableLazyBlocks(parse);
+        }
+        bool speculated = parseThreads > 0 && !replayTokens && !hashConsingEnabled()
+                       && parseInParallel(lexedChunks(), parseThreads, programStatements, parse);
+        if(!speculated){
+            ParseContext serial;
+            serial.statements = &programStatements;
+            if(lazyBlocks){
+                serial.source = &lazyScanner;
+            }
+            parsed = parse(serial) == 0;
+        }
+    }
     printf("Parsing finished.\n");
 
     // print ast (syntax tree)
     printf("\n==== Abstract Syntax Tree ====\n");
-    for(Stmt* s:programStatements){
-        printStmt(s, 0);
+    if(cacheHit){
+        fputs(cached.listing.c_str(), stdout);
+    }else if(!cacheDir.empty()){
+        cached.listing = listProgram(programStatements);
+        fputs(cached.listing.c_str(), stdout);
+    }else{
+        for(Stmt* s:programStatements){
+            printStmt(s, 0);
+        }
+    }
+
+    // the optimizer does not keep the hashes, take it from the tree as parsed
+    if(!cacheHit){
+        cached.programHash = programHash(programStatements);
+    }
+    if(printHash){
+        printf("\n==== Program Hash ====\n%s\n", cached.programHash.hex().c_str());
+    }
+
+    // optimize after printing so the tree above is always what was written
+    if(optimize && !cacheHit){
+        // the passes rewrite nodes in place, shared nodes have to become a tree again
+        if(hashConsingEnabled()){
+            for(Stmt*& s:programStatements){
+                Stmt* copy = cloneStmt(s);
+                delete s;
+                s = copy;
+            }
+            releaseInterned();
+        }
+        optimizeProgram(programStatements);
+    }
+    // a program with syntax errors or unknown characters is parsed again every time, so the
+    // messages show up again
+    if(!cacheDir.empty() && !cacheHit && parsed && !hasUnknownTokens(source)){
+        cached.program = programStatements;
+        storeCachedProgram(cacheDir, key, cached);
+    }
+    if(!emitAstBin.empty() && !writeAstBinary(emitAstBin, programStatements)){
+        fprintf(stderr, "Cannot write %s\n", emitAstBin.c_str());
+        return 1;
+    }
+    // warnings go out before anything runs. they need the whole program
+    if(!lazyBlocks){
+        checkDeclarations(programStatements);
     }
 
     //execute program
@@ -242,12 +685,25 @@ int main(){
     }
 
     printSymbolTable();
+    if(stats){
+        printOptStats();
+        if(hashConsingEnabled()){
+            printHashConsStats();
+        }
+        if(!cacheDir.empty()){
+            printCacheStats(cacheDir);
+        }
+        if(lazyBlocks){
+            printLazyBlockStats();
+        }
+    }
 
     // cleanup: delete all ast nodes
     for(Stmt* s:programStatements){
         delete s;
     }
     programStatements.clear();
+    releaseInterned();
 
     return 0;
 }
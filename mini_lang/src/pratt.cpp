@@ -0,0 +1,220 @@
+// hand-written parser: recursive descent for statements, operator precedence (pratt) for
+// expressions.
+// the grammar in parser.y spells precedence as a chain of rules, so bison reduces a lone
+// literal through primary, unary, factor, term, comparision, equality and expression
+// before it gets to use it. here an expression is one loop that reads an operand and then
+// keeps taking operators as long as they bind tighter than the caller's:
+//
+//   a + b * c < d       expression(0): a, '+' (3) > 0: b * c first, since '*' (4) > 3,
+//                       then '<' (2) is not > 3, back to 0: (a + (b * c)) < d
+//
+// equal powers stop the inner loop, which makes every operator left associative like the
+// grammar's left recursive rules.
+//
+// the nodes are made by the same calls as the grammar actions (hashed(), make*Expr), so
+// the trees, their hashes and hash-consing come out the same. tokens are read as late as
+// bison reads them, one token of lookahead when a decision needs it, and a syntax error is
+// reported at the token bison stops at: the statements before it are kept and unknown
+// characters up to it are printed, the same output as yyparse.
+
+#include "pratt.hpp"
+#include "parser.tab.hpp"
+#include<cstdlib>
+
+namespace {
+
+const int noToken = -2;
+
+// bison gives up at 10000 stack entries; this bounds the recursion instead, so very deep
+// nesting is rejected too, at a somewhat different depth
+const int maxDepth = 10000;
+
+struct SyntaxError {
+    const char* message;
+    int result;             // what yyparse returns for it
+};
+
+// power of a binary operator token and the BinaryExpr operator it makes, 0 for any other
+// token
+int bindingPower(int kind, char& op){
+    switch(kind){
+        case EQ:    op = 'E'; return 1;
+        case NEQ:   op = 'N'; return 1;
+        case LT:    op = '<'; return 2;
+        case GT:    op = '>'; return 2;
+        case LE:    op = 'L'; return 2;
+        case GE:    op = 'G'; return 2;
+        case PLUS:  op = '+'; return 3;
+        case MINUS: op = '-'; return 3;
+        case MUL:   op = '*'; return 4;
+        case DIV:   op = '/'; return 4;
+        default:    return 0;
+    }
+}
+
+// partly built nodes are dropped on a syntax error, as the bison parser drops its values
+struct Parser {
+    ParseContext& context;
+    int lookahead = noToken;
+    YYSTYPE value;
+    int depth = 0;
+
+    int peek(){
+        if(lookahead == noToken) lookahead = nextToken(&value, context);
+        return lookahead;
+    }
+
+    bool accept(int kind){
+        if(peek() != kind) return false;
+        lookahead = noToken;
+        return true;
+    }
+
+    YYSTYPE expect(int kind){
+        if(peek() != kind) throw SyntaxError{ "syntax error", 1 };
+        lookahead = noToken;
+        return value;
+    }
+
+    void enter(){
+        if(++depth > maxDepth) throw SyntaxError{ "memory exhausted", 2 };
+    }
+
+    Stmt* statement();
+    Expr* expression(int power);
+    Expr* unary();
+};
+
+Stmt* Parser::statement(){
+    enter();
+    Stmt* s;
+    switch(peek()){
+        case VAR: {
+            lookahead = noToken;
+            char* name = expect(IDENTIFIER).sval;
+            if(accept(SEMICOLON)){
+                s = hashed(new VarDeclStmt(name));
+            }else{
+                expect(ASSIGN);
+                Expr* init = expression(0);
+                expect(SEMICOLON);
+                s = hashed(new VarDeclInitStmt(name, init));
+            }
+            free(name);
+            break;
+        }
+        case IDENTIFIER: {
+            char* name = expect(IDENTIFIER).sval;
+            expect(ASSIGN);
+            Expr* e = expression(0);
+            expect(SEMICOLON);
+            s = hashed(new AssignStmt(name, e));
+            free(name);
+            break;
+        }
+        case IF: {
+            lookahead = noToken;
+            expect(LPAREN);
+            Expr* cond = expression(0);
+            expect(RPAREN);
+            Stmt* then = statement();
+            // the dangling else goes to the nearest if, as bison's shift does
+            if(accept(ELSE)){
+                Stmt* otherwise = statement();
+                s = hashed(new IfStmt(cond, then, otherwise));
+            }else{
+                s = hashed(new IfStmt(cond, then));
+            }
+            break;
+        }
+        case WHILE: {
+            lookahead = noToken;
+            expect(LPAREN);
+            Expr* cond = expression(0);
+            expect(RPAREN);
+            Stmt* body = statement();
+            s = hashed(new WhileStmt(cond, body));
+            break;
+        }
+        case LBRACE: {
+            lookahead = noToken;
+            std::vector<Stmt*> stmts;
+            while(!accept(RBRACE)){
+                stmts.push_back(statement());
+            }
+            s = hashed(new BlockStmt(stmts));
+            break;
+        }
+        case LAZYBLOCK:
+            s = expect(LAZYBLOCK).stmt;
+            break;
+        default:
+            throw SyntaxError{ "syntax error", 1 };
+    }
+    depth--;
+    return s;
+}
+
+Expr* Parser::expression(int power){
+    enter();
+    Expr* left = unary();
+    char op = 0;
+    int next;
+    while((next = bindingPower(peek(), op)) > power){
+        lookahead = noToken;
+        Expr* right = expression(next);
+        left = makeBinaryExpr(op, left, right);
+    }
+    depth--;
+    return left;
+}
+
+Expr* Parser::unary(){
+    enter();
+    Expr* e;
+    switch(peek()){
+        case PLUS:
+            lookahead = noToken;
+            e = unary();
+            break;
+        case MINUS: {
+            lookahead = noToken;
+            Expr* operand = unary();
+            e = makeBinaryExpr('n', makeIntExpr(0), operand);
+            break;
+        }
+        case INTEGER:
+            e = makeIntExpr(expect(INTEGER).ival);
+            break;
+        case IDENTIFIER: {
+            char* name = expect(IDENTIFIER).sval;
+            e = makeVarExpr(name);
+            free(name);
+            break;
+        }
+        case LPAREN:
+            lookahead = noToken;
+            e = expression(0);
+            expect(RPAREN);
+            break;
+        default:
+            throw SyntaxError{ "syntax error", 1 };
+    }
+    depth--;
+    return e;
+}
+
+} // namespace
+
+int prattParse(ParseContext& context){
+    Parser parser{ context };
+    try{
+        while(parser.peek() != 0){
+            context.statements->push_back(parser.statement());
+        }
+    }catch(const SyntaxError& error){
+        yyerror(context, error.message);
+        return error.result;
+    }
+    return 0;
+}
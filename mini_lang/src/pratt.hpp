@@ -0,0 +1,17 @@
+#ifndef PRATT_HPP
+#define PRATT_HPP
+
+// hand-written parser (pratt.cpp), an alternative to the bison parser in parser.y that
+// builds the same nodes. --parser=pratt selects it.
+
+#include "specparse.hpp"
+
+// the token source and the error report of the bison parser (parser.y), shared by both
+int nextToken(union YYSTYPE* lval, ParseContext& context);
+void yyerror(ParseContext& context, const char* s);
+
+// parses like yyparse(context): the top-level statements go to context.statements, 0 on
+// success, 1 after a syntax error (reported through yyerror), 2 if nesting is too deep
+int prattParse(ParseContext& context);
+
+#endif
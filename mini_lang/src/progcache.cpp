@@ -0,0 +1,514 @@
+// on-disk cache of compiled programs.
+// an entry is one file, DIR/<key>.mlc, holding everything a run takes from the parser and
+// the optimizer: the ast listing that gets printed, the program hash, the optimizer's
+// counters and the optimized tree. the file is mapped into memory and the tree is rebuilt
+// from it in one pass, so a warm start costs a read of the file instead of lexing, parsing
+// and every optimization pass.
+//
+//   header      magic "MLCACHE\0", format version, byte order mark, key, checksum of
+//               everything after the header
+//   listing     u32 length + text
+//   hash        program hash, 2 x u64
+//   stats       u32 field count + OptStats fields
+//   temps       u32 optimizer temporaries used by the tree
+//   program     u32 statement count + nodes in preorder
+//
+// a node is a one byte tag followed by its fields and children (0 for a missing child).
+// the optimizer's annotations (ranges, lowered arithmetic, temporary steps, closed forms)
+// are stored with the nodes; provenDeclared is not, checkDeclarations() sets it again.
+// integers are stored in the machine's byte order, an entry written with another byte
+// order, by another format version or with a different OptStats layout is a miss and gets
+// overwritten. bump formatVersion whenever a node gains a field.
+//
+// DIR/counters keeps the hits and misses of all runs for --stats.
+
+#include "progcache.hpp"
+#include "optimize.hpp"
+#include<cstdio>
+#include<cstring>
+#include<fcntl.h>
+#include<iostream>
+#include<sstream>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+namespace {
+
+const char magic[8] = { 'M', 'L', 'C', 'A', 'C', 'H', 'E', '\0' };
+const uint32_t formatVersion = 1;
+const uint32_t byteOrderMark = 0x01020304;
+
+enum RunResult { notUsed, hit, miss };
+RunResult runResult = notUsed;
+
+std::string entryPath(const std::string& dir, const Hash128& key){
+    return dir + "/" + key.hex() + ".mlc";
+}
+
+// ---------- writing ----------
+
+struct Writer {
+    std::string out;
+
+    void u8(uint8_t v){ out.push_back((char)v); }
+    void u32(uint32_t v){ out.append((const char*)&v, sizeof(v)); }
+    void u64(uint64_t v){ out.append((const char*)&v, sizeof(v)); }
+    void i32(int v){ u32((uint32_t)v); }
+
+    void str(const std::string& s){
+        u32((uint32_t)s.size());
+        out.append(s);
+    }
+
+    void names(const std::vector<std::string>& list){
+        u32((uint32_t)list.size());
+        for(const std::string& s : list) str(s);
+    }
+
+    void expr(Expr* e);
+    void stmt(Stmt* s);
+};
+
+void Writer::expr(Expr* e){
+    if(!e){
+        u8(0);
+    }else if(auto intExpr = dynamic_cast<IntExpr*>(e)){
+        u8('I');
+        i32(intExpr->value);
+    }else if(auto varExpr = dynamic_cast<VarExpr*>(e)){
+        u8('V');
+        str(varExpr->name);
+    }else if(auto binExpr = dynamic_cast<BinaryExpr*>(e)){
+        u8('B');
+        u8(binExpr->op);
+        i32(binExpr->minValue);
+        i32(binExpr->maxValue);
+        u8(binExpr->divisorNonZero);
+        u8(binExpr->lowered.kind);
+        i32(binExpr->lowered.shiftA);
+        i32(binExpr->lowered.shiftB);
+        i32(binExpr->lowered.magic);
+        expr(binExpr->left);
+        expr(binExpr->right);
+    }else if(auto tempExpr = dynamic_cast<TempExpr*>(e)){
+        u8('T');
+        i32(tempExpr->slot);
+    }else if(auto tempStore = dynamic_cast<TempStoreExpr*>(e)){
+        u8('S');
+        i32(tempStore->slot);
+        expr(tempStore->expr);
+    }else if(auto select = dynamic_cast<SelectExpr*>(e)){
+        u8('?');
+        expr(select->condition);
+        expr(select->ifTrue);
+        expr(select->ifFalse);
+    }
+}
+
+void Writer::stmt(Stmt* s){
+    if(!s){
+        u8(0);
+    }else if(auto decl = dynamic_cast<VarDeclStmt*>(s)){
+        u8('d');
+        str(decl->name);
+    }else if(auto declInit = dynamic_cast<VarDeclInitStmt*>(s)){
+        u8('i');
+        str(declInit->name);
+        expr(declInit->expr);
+    }else if(auto assign = dynamic_cast<AssignStmt*>(s)){
+        u8('a');
+        str(assign->name);
+        u32((uint32_t)assign->steps.size());
+        for(const TempStep& step : assign->steps){
+            i32(step.slot);
+            i32(step.by);
+            i32(step.amount);
+        }
+        expr(assign->expr);
+    }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(s)){
+        u8('t');
+        i32(tempAssign->slot);
+        expr(tempAssign->expr);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(s)){
+        u8('f');
+        expr(ifStmt->condition);
+        stmt(ifStmt->thenStmt);
+        stmt(ifStmt->elseStmt);
+    }else if(auto loop = dynamic_cast<ClosedFormWhileStmt*>(s)){
+        u8('c');
+        expr(loop->condition);
+        stmt(loop->body);
+        str(loop->counter);
+        u8(loop->counterOnLeft);
+        u8(loop->cmp);
+        names(loop->inductions);
+        u32((uint32_t)loop->steps.size());
+        for(int step : loop->steps) i32(step);
+        names(loop->accumulators);
+        names(loop->derived);
+        i32(loop->degree);
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(s)){
+        u8(dynamic_cast<DoWhileStmt*>(s) ? 'o' : 'w');
+        expr(whileStmt->condition);
+        stmt(whileStmt->body);
+    }else if(auto blockStmt = dynamic_cast<BlockStmt*>(s)){
+        u8('k');
+        u32((uint32_t)blockStmt->statements.size());
+        for(Stmt* child : blockStmt->statements) stmt(child);
+    }
+}
+
+// temporaries are numbered from 0 in every run, the loaded tree needs the same slots
+void noteTemp(int slot, int& count){
+    if(slot + 1 > count) count = slot + 1;
+}
+
+void countTemps(Expr* e, int& count){
+    if(auto binExpr = dynamic_cast<BinaryExpr*>(e)){
+        countTemps(binExpr->left, count);
+        countTemps(binExpr->right, count);
+    }else if(auto tempExpr = dynamic_cast<TempExpr*>(e)){
+        noteTemp(tempExpr->slot, count);
+    }else if(auto tempStore = dynamic_cast<TempStoreExpr*>(e)){
+        noteTemp(tempStore->slot, count);
+        countTemps(tempStore->expr, count);
+    }else if(auto select = dynamic_cast<SelectExpr*>(e)){
+        countTemps(select->condition, count);
+        countTemps(select->ifTrue, count);
+        countTemps(select->ifFalse, count);
+    }
+}
+
+void countTemps(Stmt* s, int& count){
+    if(auto declInit = dynamic_cast<VarDeclInitStmt*>(s)){
+        countTemps(declInit->expr, count);
+    }else if(auto assign = dynamic_cast<AssignStmt*>(s)){
+        for(const TempStep& step : assign->steps){
+            noteTemp(step.slot, count);
+            noteTemp(step.by, count);
+        }
+        countTemps(assign->expr, count);
+    }else if(auto tempAssign = dynamic_cast<TempAssignStmt*>(s)){
+        noteTemp(tempAssign->slot, count);
+        countTemps(tempAssign->expr, count);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(s)){
+        countTemps(ifStmt->condition, count);
+        countTemps(ifStmt->thenStmt, count);
+        if(ifStmt->elseStmt) countTemps(ifStmt->elseStmt, count);
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(s)){
+        countTemps(whileStmt->condition, count);
+        countTemps(whileStmt->body, count);
+    }else if(auto blockStmt = dynamic_cast<BlockStmt*>(s)){
+        for(Stmt* child : blockStmt->statements) countTemps(child, count);
+    }
+}
+
+// ---------- reading ----------
+
+// reads from the mapped file. running past the end or meeting an unknown tag clears ok,
+// after that every read returns 0 and the caller throws the half built tree away
+struct Reader {
+    const char* p;
+    const char* end;
+    bool ok = true;
+
+    bool take(void* dst, size_t size){
+        if(!ok || (size_t)(end - p) < size){
+            ok = false;
+            memset(dst, 0, size);
+            return false;
+        }
+        memcpy(dst, p, size);
+        p += size;
+        return true;
+    }
+
+    uint8_t u8(){ uint8_t v; take(&v, sizeof(v)); return v; }
+    uint32_t u32(){ uint32_t v; take(&v, sizeof(v)); return v; }
+    uint64_t u64(){ uint64_t v; take(&v, sizeof(v)); return v; }
+    int i32(){ return (int)u32(); }
+
+    // a count of items, each at least one byte long
+    uint32_t count(){
+        uint32_t n = u32();
+        if(n > (size_t)(end - p)){
+            ok = false;
+            return 0;
+        }
+        return n;
+    }
+
+    std::string str(){
+        uint32_t n = count();
+        if(!ok) return std::string();
+        std::string s(p, n);
+        p += n;
+        return s;
+    }
+
+    std::vector<std::string> names(){
+        std::vector<std::string> list(count());
+        for(std::string& s : list) s = str();
+        return list;
+    }
+
+    Expr* expr();
+    Stmt* stmt();
+};
+
+Expr* Reader::expr(){
+    switch(u8()){
+        case 0: return nullptr;
+        case 'I': return new IntExpr(i32());
+        case 'V': return new VarExpr(str());
+        case 'B': {
+            char op = (char)u8();
+            auto binExpr = new BinaryExpr(op, nullptr, nullptr);
+            binExpr->minValue = i32();
+            binExpr->maxValue = i32();
+            binExpr->divisorNonZero = u8() != 0;
+            binExpr->lowered.kind = (char)u8();
+            binExpr->lowered.shiftA = i32();
+            binExpr->lowered.shiftB = i32();
+            binExpr->lowered.magic = i32();
+            binExpr->left = expr();
+            binExpr->right = expr();
+            return binExpr;
+        }
+        case 'T': return new TempExpr(i32());
+        case 'S': {
+            int slot = i32();
+            return new TempStoreExpr(slot, expr());
+        }
+        case '?': {
+            Expr* condition = expr();
+            Expr* ifTrue = expr();
+            return new SelectExpr(condition, ifTrue, expr());
+        }
+        default:
+            ok = false;
+            return nullptr;
+    }
+}
+
+Stmt* Reader::stmt(){
+    uint8_t tag = u8();
+    switch(tag){
+        case 0: return nullptr;
+        case 'd': return new VarDeclStmt(str());
+        case 'i': {
+            std::string name = str();
+            return new VarDeclInitStmt(name, expr());
+        }
+        case 'a': {
+            std::string name = str();
+            std::vector<TempStep> steps(count());
+            for(TempStep& step : steps){
+                step.slot = i32();
+                step.by = i32();
+                step.amount = i32();
+            }
+            auto assign = new AssignStmt(name, expr());
+            assign->steps = steps;
+            return assign;
+        }
+        case 't': {
+            int slot = i32();
+            return new TempAssignStmt(slot, expr());
+        }
+        case 'f': {
+            Expr* condition = expr();
+            Stmt* thenStmt = stmt();
+            return new IfStmt(condition, thenStmt, stmt());
+        }
+        case 'c': {
+            Expr* condition = expr();
+            auto loop = new ClosedFormWhileStmt(condition, stmt());
+            loop->counter = str();
+            loop->counterOnLeft = u8() != 0;
+            loop->cmp = (char)u8();
+            loop->inductions = names();
+            loop->steps.resize(count());
+            for(int& step : loop->steps) step = i32();
+            loop->accumulators = names();
+            loop->derived = names();
+            loop->degree = i32();
+            return loop;
+        }
+        case 'w':
+        case 'o': {
+            Expr* condition = expr();
+            Stmt* body = stmt();
+            if(tag == 'o') return new DoWhileStmt(condition, body);
+            return new WhileStmt(condition, body);
+        }
+        case 'k': {
+            std::vector<Stmt*> statements(count());
+            for(Stmt*& child : statements) child = stmt();
+            return new BlockStmt(statements);
+        }
+        default:
+            ok = false;
+            return nullptr;
+    }
+}
+
+// ---------- counters ----------
+
+void readCounters(const std::string& dir, long long& hits, long long& misses){
+    hits = misses = 0;
+    FILE* f = fopen((dir + "/counters").c_str(), "r");
+    if(!f) return;
+    if(fscanf(f, "hits %lld misses %lld", &hits, &misses) != 2) hits = misses = 0;
+    fclose(f);
+}
+
+void countRun(const std::string& dir, RunResult result){
+    runResult = result;
+    long long hits, misses;
+    readCounters(dir, hits, misses);
+    (result == hit ? hits : misses)++;
+    mkdir(dir.c_str(), 0777);
+    FILE* f = fopen((dir + "/counters").c_str(), "w");
+    if(!f) return;
+    fprintf(f, "hits %lld misses %lld\n", hits, misses);
+    fclose(f);
+}
+
+bool readEntry(Reader& in, const Hash128& key, CachedProgram& out){
+    char fileMagic[8];
+    in.take(fileMagic, sizeof(fileMagic));
+    if(memcmp(fileMagic, magic, sizeof(magic)) != 0 || in.u32() != formatVersion || in.u32() != byteOrderMark) return false;
+    Hash128 fileKey, checksum;
+    fileKey.hi = in.u64();
+    fileKey.lo = in.u64();
+    checksum.hi = in.u64();
+    checksum.lo = in.u64();
+    if(!in.ok || fileKey != key || hashBytes(in.p, in.end - in.p) != checksum) return false;
+
+    out.listing = in.str();
+    out.programHash.hi = in.u64();
+    out.programHash.lo = in.u64();
+
+    OptStats stats;
+    if(in.u32() != sizeof(OptStats) / sizeof(int)) return false;
+    in.take(&stats, sizeof(stats));
+
+    uint32_t temps = in.u32();
+    uint32_t n = in.count();
+    for(uint32_t k = 0; k < n && in.ok; k++){
+        out.program.push_back(in.stmt());
+    }
+    if(!in.ok || in.p != in.end){
+        for(Stmt* s : out.program){
+            delete s;
+        }
+        out.program.clear();
+        return false;
+    }
+
+    optStats = stats;
+    for(uint32_t k = 0; k < temps; k++){
+        newTempSlot();
+    }
+    return true;
+}
+
+} // namespace
+
+Hash128 cacheKey(const std::string& source, bool optimize){
+    std::string options = "mini_lang cache " + std::to_string(formatVersion)
+                        + " optimize " + std::to_string(optimize)
+                        + " unswitch " + std::to_string(optOptions.unswitchBudget)
+                        + " unroll " + std::to_string(optOptions.unrollFactor)
+                        + " ifconv " + std::to_string(optOptions.ifConvert)
+                        + " rotate " + std::to_string(optOptions.rotateLoops) + "\n";
+    std::string text = options + source;
+    return hashBytes(text.data(), text.size());
+}
+
+bool loadCachedProgram(const std::string& dir, const Hash128& key, CachedProgram& out){
+    int fd = open(entryPath(dir, key).c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0){
+        if(fd >= 0) close(fd);
+        countRun(dir, miss);
+        return false;
+    }
+
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        countRun(dir, miss);
+        return false;
+    }
+
+    Reader in{ (const char*)data, (const char*)data + info.st_size };
+    bool found = readEntry(in, key, out);
+    munmap(data, info.st_size);
+    countRun(dir, found ? hit : miss);
+    return found;
+}
+
+void storeCachedProgram(const std::string& dir, const Hash128& key, const CachedProgram& entry){
+    Writer w;
+    w.str(entry.listing);
+    w.u64(entry.programHash.hi);
+    w.u64(entry.programHash.lo);
+    w.u32(sizeof(OptStats) / sizeof(int));
+    w.out.append((const char*)&optStats, sizeof(optStats));
+
+    int temps = 0;
+    for(Stmt* s : entry.program){
+        countTemps(s, temps);
+    }
+    w.u32((uint32_t)temps);
+    w.u32((uint32_t)entry.program.size());
+    for(Stmt* s : entry.program){
+        w.stmt(s);
+    }
+
+    Writer header;
+    Hash128 checksum = hashBytes(w.out.data(), w.out.size());
+    header.out.append(magic, sizeof(magic));
+    header.u32(formatVersion);
+    header.u32(byteOrderMark);
+    header.u64(key.hi);
+    header.u64(key.lo);
+    header.u64(checksum.hi);
+    header.u64(checksum.lo);
+
+    // written under a private name and renamed, so a reader never sees half a file
+    mkdir(dir.c_str(), 0777);
+    std::string path = entryPath(dir, key);
+    std::string temp = path + "." + std::to_string(getpid());
+    FILE* f = fopen(temp.c_str(), "wb");
+    if(!f) return;
+    bool written = fwrite(header.out.data(), 1, header.out.size(), f) == header.out.size()
+                && fwrite(w.out.data(), 1, w.out.size(), f) == w.out.size();
+    written = fclose(f) == 0 && written;
+    if(!written || rename(temp.c_str(), path.c_str()) != 0){
+        remove(temp.c_str());
+    }
+}
+
+void printStmt(Stmt* stmt, int indent);
+
+std::string listProgram(const std::vector<Stmt*>& stmts){
+    std::ostringstream text;
+    std::streambuf* console = std::cout.rdbuf(text.rdbuf());
+    for(Stmt* s : stmts){
+        printStmt(s, 0);
+    }
+    std::cout.rdbuf(console);
+    return text.str();
+}
+
+void printCacheStats(const std::string& dir){
+    long long hits, misses;
+    readCounters(dir, hits, misses);
+    std::cout<<"\n---- Program Cache ----\n";
+    std::cout<<"this run: "<<(runResult == hit ? "hit" : "miss")<<"\n";
+    std::cout<<"all runs: "<<hits<<" hits, "<<misses<<" misses\n";
+}
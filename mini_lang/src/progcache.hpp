@@ -0,0 +1,36 @@
+#ifndef PROGCACHE_HPP
+#define PROGCACHE_HPP
+
+// on-disk cache of compiled programs (progcache.cpp).
+// with --cache-dir=DIR the source is hashed before parsing. if DIR holds an entry for that
+// hash the program is loaded from it and yyparse and the optimizer never run; otherwise
+// the program is parsed and optimized as usual and then stored for the next run.
+
+#include "ast.hpp"
+#include<string>
+#include<vector>
+
+// what a run needs from the parser and the optimizer
+struct CachedProgram {
+    std::string listing;        // the printed ast as parsed
+    Hash128 programHash;        // see programHash()
+    std::vector<Stmt*> program; // optimized, ready for checkDeclarations and execStmt
+};
+
+// key of a source text: covers the text, whether it is optimized, every optOptions field
+// and the format version
+Hash128 cacheKey(const std::string& source, bool optimize);
+
+// false on a miss (no entry, other format version, damaged file). on a hit optStats is
+// set to what the optimizer did when the entry was stored
+bool loadCachedProgram(const std::string& dir, const Hash128& key, CachedProgram& out);
+
+// writes the entry and the current optStats, does nothing if dir can not be written
+void storeCachedProgram(const std::string& dir, const Hash128& key, const CachedProgram& entry);
+
+// the ast dump printStmt writes, as a string
+std::string listProgram(const std::vector<Stmt*>& stmts);
+
+void printCacheStats(const std::string& dir);   // --stats: hits and misses of the directory
+
+#endif
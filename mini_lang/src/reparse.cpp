@@ -0,0 +1,283 @@
+// incremental reparsing (see reparse.hpp).
+// the statements are cut where specparse.cpp cuts them, at a ';' or '}' outside any
+// bracket that no else follows, so the text between two cuts is a statement list of its
+// own. a reparse scans from the end of the last statement before the edit and stops at the
+// first cut after it that was a cut last time too: from there on the text is the same, so
+// are its tokens, and the old statements are still right. only the tokens in between are
+// parsed, into statements that replace the old ones between the two cuts.
+//
+// most of a long statement is usually its blocks. when the scanner meets a '{' whose block
+// the edit did not touch, the old BlockStmt goes to the parser as a single LAZYBLOCK token
+// (by value, see ParseContext::blocks) and the scan goes on after its '}'. the kept nodes
+// are moved into the new statements; before the old ones are deleted the slots that held
+// them are cleared. a block is kept by position, so a reparse costs about the length of
+// the statements around the edit minus the blocks in them it does not reach.
+//
+// characters no token starts with are skipped without a message. keeping the offsets of
+// the statements after the edit up to date is a pass over all of them, cheap next to
+// scanning, and so is moving the text behind the edit in the string.
+
+#include "reparse.hpp"
+#include "parser.tab.hpp"
+#include<algorithm>
+#include<stdexcept>
+
+namespace {
+
+// a block of an old statement handed to the parser again
+struct Reused {
+    size_t piece;
+    size_t block;       // index in the piece's blocks
+    long long shift;    // offset in pieces + shift = offset in the source
+};
+
+// kept is sorted
+bool isKept(const std::vector<Stmt*>& kept, Stmt* s){
+    return std::binary_search(kept.begin(), kept.end(), s);
+}
+
+// clears the slots under slot (and slot itself) that hold a kept block, so deleting the
+// statement does not delete those
+void detach(Stmt*& slot, const std::vector<Stmt*>& kept){
+    if(!slot) return;
+    if(isKept(kept, slot)){
+        slot = nullptr;
+        return;
+    }
+    if(auto block = dynamic_cast<BlockStmt*>(slot)){
+        for(Stmt*& s : block->statements) detach(s, kept);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(slot)){
+        detach(ifStmt->thenStmt, kept);
+        detach(ifStmt->elseStmt, kept);
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(slot)){
+        detach(whileStmt->body, kept);
+    }
+}
+
+// the blocks the parser built in stmt, in the order of their '{'
+void newBlocks(Stmt* stmt, const std::vector<Stmt*>& kept, std::vector<BlockStmt*>& out){
+    if(!stmt || isKept(kept, stmt)) return;
+    if(auto block = dynamic_cast<BlockStmt*>(stmt)){
+        out.push_back(block);
+        for(Stmt* s : block->statements) newBlocks(s, kept, out);
+    }else if(auto ifStmt = dynamic_cast<IfStmt*>(stmt)){
+        newBlocks(ifStmt->thenStmt, kept, out);
+        newBlocks(ifStmt->elseStmt, kept, out);
+    }else if(auto whileStmt = dynamic_cast<WhileStmt*>(stmt)){
+        newBlocks(whileStmt->body, kept, out);
+    }
+}
+
+} // namespace
+
+IncrementalParser::IncrementalParser(int (*parse)(ParseContext&)) : parse(parse) {}
+
+IncrementalParser::~IncrementalParser(){
+    for(Stmt* s : program) delete s;
+}
+
+bool IncrementalParser::reset(const std::string& text){
+    for(Stmt* s : program) delete s;
+    program.clear();
+    pieces.clear();
+    source = text;
+    source.append(scanPadding, '\0');
+    length = text.size();
+    // all of it is new
+    dirty = true;
+    dirtyStart = 0;
+    dirtyEnd = 0;
+    delta = (long long)length;
+    return reparse();
+}
+
+bool IncrementalParser::edit(size_t offset, size_t removed, const std::string& text){
+    if(offset > length) throw std::out_of_range("edit past the end of the source");
+    removed = std::min(removed, length - offset);
+    if(!dirty){
+        dirty = true;
+        dirtyStart = offset;
+        dirtyEnd = offset;
+        delta = 0;
+    }
+    // grow the edited region to cover this edit too. before the region the offsets are
+    // those of pieces, after it they are off by delta
+    size_t end = std::max((size_t)(dirtyEnd + delta), offset + removed);
+    dirtyStart = std::min(dirtyStart, offset);
+    dirtyEnd = (size_t)(end - delta);
+    delta += (long long)text.size() - (long long)removed;
+
+    source.replace(offset, removed, text);
+    length = length - removed + text.size();
+    return reparse();
+}
+
+bool IncrementalParser::reparse(){
+    const char* base = source.data();
+    size_t editedEnd = (size_t)(dirtyEnd + delta);    // the edited region is [dirtyStart, editedEnd) now
+
+    // the old block at a '{' of the source, if the edit did not reach it
+    auto keptBlock = [&](size_t at, Reused& r){
+        size_t old;
+        if(at < dirtyStart){
+            old = at;
+            r.shift = 0;
+        }else if(at >= editedEnd){
+            old = (size_t)(at - delta);
+            r.shift = delta;
+        }else{
+            return false;
+        }
+        auto piece = std::upper_bound(pieces.begin(), pieces.end(), old,
+                                      [](size_t o, const Piece& p){ return o < p.start; });
+        if(piece == pieces.begin()) return false;
+        --piece;
+        if(old >= piece->end) return false;
+        size_t open = old - piece->start;
+        auto block = std::lower_bound(piece->blocks.begin(), piece->blocks.end(), open,
+                                      [](const Block& b, size_t o){ return b.open < o; });
+        if(block == piece->blocks.end() || block->open != open) return false;
+        if(old < dirtyStart && piece->start + block->close >= dirtyStart) return false;
+        r.piece = piece - pieces.begin();
+        r.block = block - piece->blocks.begin();
+        return true;
+    };
+
+    // the old statements [first, after) are scanned and parsed again
+    size_t first = std::partition_point(pieces.begin(), pieces.end(),
+                                        [&](const Piece& p){ return p.end < dirtyStart; }) - pieces.begin();
+    size_t after;
+    std::vector<Token> tokens;
+    std::vector<Reused> reused;
+    std::vector<Stmt*> nodes;
+    for(;;){
+        tokens.clear();
+        reused.clear();
+        nodes.clear();
+        after = pieces.size();
+        Scanner scanner = { base + (first > 0 ? pieces[first - 1].end : 0), base + length };
+        size_t next = first;    // the first old statement that may end past the edit
+        int braces = 0, parens = 0;
+        Token t;
+        for(;;){
+            scanToken(scanner, t);
+            if(t.kind == 0) break;
+            if(t.kind == unknownToken) continue;
+            size_t at = t.text - base;
+            Reused r;
+            if(t.kind == LBRACE && keptBlock(at, r)){
+                const Piece& piece = pieces[r.piece];
+                size_t close = (size_t)(piece.start + piece.blocks[r.block].close + r.shift);
+                t.kind = LAZYBLOCK;
+                t.value = (int)reused.size();
+                t.length = (int)(close + 1 - at);
+                scanner.p = base + close + 1;
+                reused.push_back(r);
+                nodes.push_back(piece.blocks[r.block].node);
+            }
+            tokens.push_back(t);
+
+            if(t.kind == LBRACE) braces++;
+            if(t.kind == RBRACE) braces--;
+            if(t.kind == LPAREN) parens++;
+            if(t.kind == RPAREN) parens--;
+            size_t end = at + t.length;
+            bool closes = t.kind == SEMICOLON || t.kind == RBRACE || t.kind == LAZYBLOCK;
+            if(closes && braces == 0 && parens == 0 && end >= editedEnd){
+                size_t old = (size_t)(end - delta);
+                while(next < pieces.size() && pieces[next].end < old) next++;
+                if(next < pieces.size() && pieces[next].end == old){
+                    after = next + 1;
+                    break;
+                }
+            }
+        }
+        // the edit left an else behind the statement before it: that one belongs to it now
+        if(first > 0 && !tokens.empty() && tokens[0].kind == ELSE){
+            first--;
+            continue;
+        }
+        break;
+    }
+    tokensScanned = tokens.size();
+    statementsParsed = 0;
+    blocksReused = reused.size();
+
+    std::vector<size_t> ends = statementEnds(tokens);
+    if(!tokens.empty() && ends.empty()) return false;
+    std::vector<Stmt*> kept = nodes;
+    std::sort(kept.begin(), kept.end());
+    std::vector<Stmt*> parsed;
+    if(!tokens.empty()){
+        ParseContext context;
+        context.statements = &parsed;
+        context.next = tokens.data();
+        context.end = tokens.data() + tokens.size();
+        context.quiet = true;
+        context.blocks = nodes.data();
+        if(parse(context) != 0 || parsed.size() != ends.size()){
+            // the kept blocks still belong to the old statements
+            for(Stmt*& s : parsed){
+                detach(s, kept);
+                delete s;
+            }
+            return false;
+        }
+    }
+    statementsParsed = parsed.size();
+
+    // where the new statements and their blocks are
+    std::vector<Piece> built(ends.size());
+    size_t from = 0;
+    for(size_t k = 0; k < ends.size(); k++){
+        Piece& piece = built[k];
+        const Token& last = tokens[ends[k] - 1];
+        piece.start = tokens[from].text - base;
+        piece.end = last.text - base + last.length;
+        std::vector<size_t> open;
+        for(size_t i = from; i < ends[k]; i++){
+            const Token& t = tokens[i];
+            size_t at = t.text - base - piece.start;
+            if(t.kind == LBRACE){
+                open.push_back(piece.blocks.size());
+                piece.blocks.push_back({ at, at, nullptr });
+            }else if(t.kind == RBRACE){
+                piece.blocks[open.back()].close = at;
+                open.pop_back();
+            }else if(t.kind == LAZYBLOCK){
+                // the kept block and the ones inside it
+                const Reused& r = reused[t.value];
+                const Piece& old = pieces[r.piece];
+                long long move = (long long)old.start + r.shift - (long long)piece.start;
+                size_t close = old.blocks[r.block].close;
+                for(size_t b = r.block; b < old.blocks.size() && old.blocks[b].open <= close; b++){
+                    const Block& o = old.blocks[b];
+                    piece.blocks.push_back({ (size_t)(o.open + move), (size_t)(o.close + move), o.node });
+                }
+            }
+        }
+        std::vector<BlockStmt*> fresh;
+        newBlocks(parsed[k], kept, fresh);
+        size_t f = 0;
+        for(Block& b : piece.blocks){
+            if(!b.node) b.node = fresh[f++];
+        }
+        from = ends[k];
+    }
+
+    for(size_t k = first; k < after; k++){
+        detach(program[k], kept);
+        delete program[k];
+    }
+    pieces.erase(pieces.begin() + first, pieces.begin() + after);
+    pieces.insert(pieces.begin() + first, std::make_move_iterator(built.begin()), std::make_move_iterator(built.end()));
+    program.erase(program.begin() + first, program.begin() + after);
+    program.insert(program.begin() + first, parsed.begin(), parsed.end());
+    for(size_t k = first + parsed.size(); k < pieces.size(); k++){
+        pieces[k].start += delta;
+        pieces[k].end += delta;
+    }
+    dirty = false;
+    delta = 0;
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef REPARSE_HPP
+#define REPARSE_HPP
+
+// incremental reparsing (reparse.cpp), for a source that is edited a little at a time, as in
+// an editor. an IncrementalParser keeps the source, its top-level statements and where each
+// statement and each block in it starts and ends. after an edit only the text around the
+// change is scanned again and only the statements it touches are parsed again; the
+// statements before and after it, and every block inside the touched ones that the edit
+// does not reach, are kept as they are, nodes and hashes included.
+
+#include "specparse.hpp"
+#include<string>
+#include<vector>
+
+struct IncrementalParser {
+    // parse is yyparse or prattParse
+    explicit IncrementalParser(int (*parse)(ParseContext&));
+    ~IncrementalParser();
+    IncrementalParser(const IncrementalParser&) = delete;
+    IncrementalParser& operator=(const IncrementalParser&) = delete;
+
+    // drops everything and parses text from scratch. false after a syntax error
+    bool reset(const std::string& text);
+
+    // replaces removed bytes at offset by text and reparses what changed. false after a
+    // syntax error: the statements stay those of the last good parse, and the next edit
+    // reparses this one's region along with its own. throws std::out_of_range if offset is
+    // past the end, removed is cut off at the end
+    bool edit(size_t offset, size_t removed, const std::string& text);
+
+    // the top-level statements of the last good parse. owned by the parser, valid until
+    // the next call
+    const std::vector<Stmt*>& statements() const { return program; }
+    std::string text() const { return source.substr(0, length); }
+
+    // what the last reset() or edit() did
+    size_t tokensScanned = 0;       // a kept block counts as one
+    size_t statementsParsed = 0;
+    size_t blocksReused = 0;
+
+private:
+    // a block in a statement, offsets from the start of the statement: open is the '{',
+    // close the '}'
+    struct Block {
+        size_t open;
+        size_t close;
+        BlockStmt* node;
+    };
+
+    // a top-level statement: [start, end) is its first token to its last
+    struct Piece {
+        size_t start;
+        size_t end;
+        std::vector<Block> blocks;  // by open, so inner blocks follow the outer one
+    };
+
+    int (*parse)(ParseContext&);
+    std::string source;         // the text, then scanPadding zeros
+    size_t length = 0;
+    std::vector<Piece> pieces;
+    std::vector<Stmt*> program; // the statement of each piece
+
+    // the text edited since the last good parse: [dirtyStart, dirtyEnd) in the offsets of
+    // pieces became [dirtyStart, dirtyEnd + delta) of source
+    bool dirty = false;
+    size_t dirtyStart = 0;
+    size_t dirtyEnd = 0;
+    long long delta = 0;
+
+    bool reparse();
+};
+
+#endif
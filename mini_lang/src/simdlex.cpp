@@ -0,0 +1,327 @@
+// hand-written scanner producing the same tokens as lexer.l.
+// the flex scanner takes one table transition per byte. this one looks at 32 (avx2) or 16
+// (sse2) bytes at once wherever a token or a gap is longer than a byte or two: a vector of
+// bytes is compared against the characters of a class (blanks, identifier characters,
+// digits, anything but a newline) and the first byte outside the class is the lowest clear
+// bit of the comparison mask:
+//
+//   "count    = 1"     blanks:  1 1 1 1 0 ...   skip 4
+//        ^
+//
+// keywords are identifiers looked up in a table indexed by their length, a perfect hash
+// for var / if / else / while (2 to 5 characters, one keyword each), confirmed with one
+// compare. the instruction set is picked when the program starts; without sse2 the same
+// loops run a byte at a time.
+
+#include "simdlex.hpp"
+#include "ast.hpp"
+#include "parser.tab.hpp"
+#include<climits>
+#include<cstdio>
+#include<cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#define SCAN_X86 1
+#endif
+
+namespace {
+
+enum CharClass { blankClass, wordClass, digitClass, lineClass };
+
+bool inClass(unsigned char c, CharClass cls){
+    switch(cls){
+        case blankClass: return c == ' ' || c == '\t' || c == '\n';
+        case digitClass: return c >= '0' && c <= '9';
+        case wordClass:  return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+        default:         return c != '\n';
+    }
+}
+
+// first byte from p on that is not in the class, end if there is none
+template<CharClass cls>
+const char* skipScalar(const char* p, const char* end){
+    while(p < end && inClass((unsigned char)*p, cls)) p++;
+    return p;
+}
+
+#ifdef SCAN_X86
+
+// signed byte compares: lo <= v <= hi. lo and hi are ascii, so bytes >= 0x80 (negative)
+// are never in range
+__m128i inRange16(__m128i v, char lo, char hi){
+    return _mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)) & _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v);
+}
+
+template<CharClass cls>
+unsigned classMask16(const char* p){
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i in;
+    switch(cls){
+        case blankClass:
+            in = _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')) | _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))
+               | _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+            break;
+        case digitClass:
+            in = inRange16(v, '0', '9');
+            break;
+        case wordClass:
+            in = inRange16(v, '0', '9') | inRange16(v | _mm_set1_epi8(0x20), 'a', 'z');
+            break;
+        default:
+            in = ~_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+            break;
+    }
+    return (unsigned)_mm_movemask_epi8(in);
+}
+
+template<CharClass cls>
+inline const char* skipSse2(const char* p, const char* end){
+    while(p < end){
+        unsigned out = ~classMask16<cls>(p) & 0xffff;
+        if(out){
+            p += __builtin_ctz(out);
+            break;
+        }
+        p += 16;
+    }
+    return p < end ? p : end;
+}
+
+// the same at 32 bytes, compiled for avx2 whatever the rest of the program is built for
+__attribute__((target("avx2"))) __m256i inRange32(__m256i v, char lo, char hi){
+    return _mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)) & _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v);
+}
+
+template<CharClass cls>
+__attribute__((target("avx2"))) unsigned classMask32(const char* p){
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i in;
+    switch(cls){
+        case blankClass:
+            in = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')) | _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))
+               | _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+            break;
+        case digitClass:
+            in = inRange32(v, '0', '9');
+            break;
+        case wordClass:
+            in = inRange32(v, '0', '9') | inRange32(v | _mm256_set1_epi8(0x20), 'a', 'z');
+            break;
+        default:
+            in = ~_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+            break;
+    }
+    return (unsigned)_mm256_movemask_epi8(in);
+}
+
+template<CharClass cls>
+__attribute__((target("avx2"))) inline const char* skipAvx2(const char* p, const char* end){
+    while(p < end){
+        unsigned out = ~classMask32<cls>(p);
+        if(out){
+            p += __builtin_ctz(out);
+            break;
+        }
+        p += 32;
+    }
+    // the compiler only clears the upper halves itself when it optimizes. left dirty, they
+    // slow down every sse instruction that runs after this
+    _mm256_zeroupper();
+    return p < end ? p : end;
+}
+
+#endif
+
+enum InstructionSet { noVectors, sse2, avx2 };
+
+// resolved at compile time, so in the scanner built for an instruction set every skip is
+// inlined
+template<InstructionSet set, CharClass cls>
+__attribute__((always_inline)) inline const char* skip(const char* p, const char* end){
+#ifdef SCAN_X86
+    if constexpr(set == avx2) return skipAvx2<cls>(p, end);
+    if constexpr(set == sse2) return skipSse2<cls>(p, end);
+#endif
+    return skipScalar<cls>(p, end);
+}
+
+// atoi() of a run of digits: strtol saturates at LONG_MAX, atoi truncates that to int
+int digitsValue(const char* p, const char* end){
+    long value = 0;
+    for(; p < end; p++){
+        int digit = *p - '0';
+        if(value > (LONG_MAX - digit) / 10){
+            value = LONG_MAX;
+            break;
+        }
+        value = value * 10 + digit;
+    }
+    return (int)value;
+}
+
+struct Keyword {
+    const char* text;
+    int kind;
+};
+
+// indexed by length - 2
+const Keyword keywords[4] = { { "if", IF }, { "var", VAR }, { "else", ELSE }, { "while", WHILE } };
+
+template<InstructionSet set>
+__attribute__((always_inline)) inline void scan(Scanner& s, Token& token){
+    for(;;){
+        const char* p = s.p;
+        // most gaps are a single blank, worth testing before going wide
+        if(p < s.end && inClass((unsigned char)*p, blankClass)){
+            p = skip<set, blankClass>(p + 1, s.end);
+        }
+        if(p >= s.end){
+            s.p = s.end;
+            token.kind = 0;
+            return;
+        }
+
+        const char* next = p + 1;
+        bool more = next < s.end;
+        token.text = p;
+        token.length = 1;
+        switch(*p){
+            case '/':
+                if(more && *next == '/'){
+                    s.p = skip<set, lineClass>(next + 1, s.end);
+                    continue;
+                }
+                token.kind = DIV;
+                break;
+            case '=': token.kind = more && *next == '=' ? EQ : ASSIGN; break;
+            case '!': token.kind = more && *next == '=' ? NEQ : unknownToken; break;
+            case '<': token.kind = more && *next == '=' ? LE : LT; break;
+            case '>': token.kind = more && *next == '=' ? GE : GT; break;
+            case '+': token.kind = PLUS; break;
+            case '-': token.kind = MINUS; break;
+            case '*': token.kind = MUL; break;
+            case ';': token.kind = SEMICOLON; break;
+            case '(': token.kind = LPAREN; break;
+            case ')': token.kind = RPAREN; break;
+            case '{': token.kind = LBRACE; break;
+            case '}': token.kind = RBRACE; break;
+            default:
+                if(inClass((unsigned char)*p, digitClass)){
+                    next = skip<set, digitClass>(next, s.end);
+                    token.kind = INTEGER;
+                    token.value = digitsValue(p, next);
+                    token.length = (int)(next - p);
+                    s.p = next;
+                    return;
+                }
+                if(inClass((unsigned char)*p, wordClass)){
+                    next = skip<set, wordClass>(next, s.end);
+                    token.length = (int)(next - p);
+                    token.kind = IDENTIFIER;
+                    if(token.length >= 2 && token.length <= 5){
+                        const Keyword& k = keywords[token.length - 2];
+                        if(memcmp(p, k.text, token.length) == 0) token.kind = k.kind;
+                    }
+                    s.p = next;
+                    return;
+                }
+                token.kind = unknownToken;
+                break;
+        }
+        if(token.kind == EQ || token.kind == NEQ || token.kind == LE || token.kind == GE){
+            token.length = 2;
+        }
+        s.p = p + token.length;
+        return;
+    }
+}
+
+void scanScalar(Scanner& s, Token& token){
+    scan<noVectors>(s, token);
+}
+
+#ifdef SCAN_X86
+void scanSse2(Scanner& s, Token& token){
+    scan<sse2>(s, token);
+}
+
+__attribute__((target("avx2"))) void scanAvx2(Scanner& s, Token& token){
+    scan<avx2>(s, token);
+}
+
+InstructionSet instructionSet = __builtin_cpu_supports("avx2") ? avx2 : sse2;
+void (*scanner)(Scanner&, Token&) = instructionSet == avx2 ? scanAvx2 : scanSse2;
+#else
+InstructionSet instructionSet = noVectors;
+void (*scanner)(Scanner&, Token&) = scanScalar;
+#endif
+
+// the source handed to simdLex(), padded
+std::string buffer;
+Scanner parserScanner = { nullptr, nullptr };
+
+} // namespace
+
+void scanToken(Scanner& s, Token& token){
+    scanner(s, token);
+}
+
+const char* scannerInstructionSet(){
+    if(instructionSet == avx2) return "avx2";
+    if(instructionSet == sse2) return "sse2";
+    return "none";
+}
+
+bool selectScannerInstructionSet(const std::string& name){
+#ifdef SCAN_X86
+    if(name == "avx2" && __builtin_cpu_supports("avx2")){
+        instructionSet = avx2;
+        scanner = scanAvx2;
+        return true;
+    }
+    if(name == "sse2"){
+        instructionSet = sse2;
+        scanner = scanSse2;
+        return true;
+    }
+#endif
+    if(name == "none"){
+        instructionSet = noVectors;
+        scanner = scanScalar;
+        return true;
+    }
+    return false;
+}
+
+void setScannerSource(const std::string& source){
+    buffer = source;
+    buffer.append(scanPadding, '\0');
+    parserScanner = Scanner{ buffer.data(), buffer.data() + source.size() };
+}
+
+bool hasUnknownTokens(const std::string& source){
+    std::string padded = source + std::string(scanPadding, '\0');
+    Scanner s = { padded.data(), padded.data() + source.size() };
+    Token token;
+    do{
+        scanToken(s, token);
+        if(token.kind == unknownToken) return true;
+    }while(token.kind != 0);
+    return false;
+}
+
+int parserToken(const Token& token){
+    if(token.kind == unknownToken) printf("Unknown token: %s\n", std::string(token.text, 1).c_str());
+    if(token.kind == INTEGER) yylval.ival = token.value;
+    if(token.kind == IDENTIFIER) yylval.sval = strndup(token.text, token.length);
+    return token.kind;
+}
+
+int simdLex(){
+    Token token;
+    do{
+        scanToken(parserScanner, token);
+    }while(parserToken(token) == unknownToken);
+    return token.kind;
+}
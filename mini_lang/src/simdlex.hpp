@@ -0,0 +1,56 @@
+#ifndef SIMDLEX_HPP
+#define SIMDLEX_HPP
+
+// hand-written scanner (simdlex.cpp), an alternative to the flex scanner in lexer.l that
+// produces the same tokens. it works on a whole source in memory and keeps all its state
+// in a Scanner, so any number of them can run at once.
+
+#include<cstddef>
+#include<string>
+
+// the scanner reads up to this many bytes past the end of its input, they must be
+// readable. zeros are the safest choice
+const size_t scanPadding = 64;
+
+// a token as the parser gets it. text points into the source and is only valid as long
+// as the source is
+struct Token {
+    int kind;           // parser token (parser.tab.hpp), 0 at the end, unknownToken
+    int value;          // INTEGER: the number, as atoi() reads it
+    const char* text;   // IDENTIFIER / unknownToken: the characters
+    int length;
+};
+
+// a character no token starts with. flex prints "Unknown token" and moves on, so does
+// whoever hands the tokens to the parser
+const int unknownToken = -1;
+
+struct Scanner {
+    const char* p;
+    const char* end;    // scanPadding readable bytes follow
+};
+
+// the next token, kind 0 at the end of the input
+void scanToken(Scanner& s, Token& token);
+
+// which vector instructions scanToken uses: "avx2", "sse2" or "none"
+const char* scannerInstructionSet();
+
+// uses the named instruction set from now on, false if this cpu does not have it. the
+// default is the widest one available
+bool selectScannerInstructionSet(const std::string& name);
+
+// hands a token to the parser: sets yylval like the flex scanner does and returns the
+// kind. an unknown token is printed, the caller skips it
+int parserToken(const Token& token);
+
+// true if some character of source starts no token, so the scanners print "Unknown token"
+// for it
+bool hasUnknownTokens(const std::string& source);
+
+// the parser's view: reads the source set up by setScannerSource() (a copy is kept,
+// padded) and fills in yylval like the flex scanner does
+void setScannerSource(const std::string& source);
+int simdLex();
+
+#endif
@@ -0,0 +1,102 @@
+// speculative parallel parsing (see specparse.hpp).
+// a program is a list of top-level statements, and in this grammar the first token after
+// a statement never changes how the statement parses, with one exception: an else after
+// an if. so the tokens can be cut after every ';' or '}' that is outside all braces and
+// parentheses and not followed by an else:
+//
+//   var a = 1; | while (a < 9) { a = a + 1; } | if (a > 3) b = 1; else b = 2; | { c = a; }
+//
+// every piece is a statement list of its own, parsing the pieces one by one gives the
+// same statements as parsing the whole, and the pieces can be parsed at once. the cuts are
+// only a guess for programs with syntax errors: a stray brace, a missing ';'. then some
+// piece fails to parse, everything is thrown away and the caller parses serially, which
+// prints the error where it always did.
+//
+// unknown characters never reach the parser, they are left out of the pieces and printed
+// in order once all pieces parsed. the parser prints nothing else while it succeeds, so the
+// output is the same.
+
+#include "specparse.hpp"
+#include "parser.tab.hpp"
+#include<algorithm>
+#include<cstdio>
+#include<string>
+#include<thread>
+
+std::vector<size_t> statementEnds(const std::vector<Token>& tokens){
+    std::vector<size_t> ends;
+    int braces = 0, parens = 0;
+    for(size_t i = 0; i < tokens.size(); i++){
+        int kind = tokens[i].kind;
+        if(kind == LBRACE) braces++;
+        if(kind == RBRACE) braces--;
+        if(kind == LPAREN) parens++;
+        if(kind == RPAREN) parens--;
+        if(braces < 0 || parens < 0) return {};
+        bool elseFollows = i + 1 < tokens.size() && tokens[i + 1].kind == ELSE;
+        bool closes = kind == SEMICOLON || kind == RBRACE || kind == LAZYBLOCK;
+        if(braces == 0 && parens == 0 && closes && !elseFollows){
+            ends.push_back(i + 1);
+        }
+    }
+    if(ends.empty() || ends.back() != tokens.size()) return {};
+    return ends;
+}
+
+bool parseInParallel(const std::vector<std::vector<Token>>& chunks, int threads, std::vector<Stmt*>& out,
+                     int (*parse)(ParseContext&)){
+    std::vector<Token> tokens;
+    std::vector<Token> unknown;
+    for(const std::vector<Token>& chunk : chunks){
+        for(const Token& t : chunk){
+            (t.kind == unknownToken ? unknown : tokens).push_back(t);
+        }
+    }
+
+    if(!tokens.empty()){
+        std::vector<size_t> ends = statementEnds(tokens);
+        if(ends.empty()) return false;
+
+        // one piece per thread, cut at the statement end nearest above an equal share
+        std::vector<size_t> cuts = { 0 };
+        for(int k = 1; k < threads; k++){
+            size_t target = tokens.size() / threads * k;
+            auto cut = std::lower_bound(ends.begin(), ends.end(), target);
+            if(cut != ends.end() && *cut > cuts.back() && *cut < tokens.size()) cuts.push_back(*cut);
+        }
+        cuts.push_back(tokens.size());
+
+        size_t pieces = cuts.size() - 1;
+        std::vector<std::vector<Stmt*>> statements(pieces);
+        std::vector<char> parsed(pieces);
+        auto parsePiece = [&](size_t k){
+            ParseContext context;
+            context.statements = &statements[k];
+            context.next = tokens.data() + cuts[k];
+            context.end = tokens.data() + cuts[k + 1];
+            context.quiet = true;
+            parsed[k] = parse(context) == 0;
+        };
+        std::vector<std::thread> workers;
+        for(size_t k = 1; k < pieces; k++){
+            workers.emplace_back(parsePiece, k);
+        }
+        parsePiece(0);
+        for(std::thread& w : workers) w.join();
+
+        if(std::find(parsed.begin(), parsed.end(), 0) != parsed.end()){
+            for(std::vector<Stmt*>& piece : statements){
+                for(Stmt* s : piece) delete s;
+            }
+            return false;
+        }
+        for(std::vector<Stmt*>& piece : statements){
+            out.insert(out.end(), piece.begin(), piece.end());
+        }
+    }
+
+    for(const Token& t : unknown){
+        printf("Unknown token: %s\n", std::string(t.text, 1).c_str());
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef SPECPARSE_HPP
+#define SPECPARSE_HPP
+
+// speculative parallel parsing of top-level statements (specparse.cpp).
+// with --parse-threads=N the tokens scanned by parlex.cpp are cut between top-level
+// statements, and up to N parser instances parse the pieces at once. if every piece parses
+// the statements are put together in order; otherwise nothing is kept and main() parses
+// the whole input again on one thread, so syntax errors come out exactly as without it.
+
+#include "ast.hpp"
+#include "simdlex.hpp"
+#include<vector>
+
+struct Bytecode;
+
+// what one yyparse() call works on. the parser is pure (no globals), so any number of
+// them can run at once
+struct ParseContext {
+    std::vector<Stmt*>* statements;     // where the top-level statements go
+    const Token* next = nullptr;        // the tokens of a piece; nullptr: the lexer main() set up
+    const Token* end = nullptr;
+    bool quiet = false;                 // no syntax error messages, the caller falls back
+    Bytecode* code = nullptr;           // --single-pass: the actions emit code here, no nodes
+    Scanner* source = nullptr;          // --lazy-blocks: scan here, blocks are only matched
+    Stmt* const* blocks = nullptr;      // the nodes of the LAZYBLOCK tokens in a piece, by value
+};
+
+// where the top-level statements in tokens end (one past their last token). empty if the
+// tokens can not be a statement list: unbalanced brackets or an unfinished last statement
+std::vector<size_t> statementEnds(const std::vector<Token>& tokens);
+
+// parses the chunks (see lexedChunks()) with up to threads parsers and appends the
+// statements to out. false, and out untouched, if any piece has a syntax error.
+// parse is yyparse or prattParse
+bool parseInParallel(const std::vector<std::vector<Token>>& chunks, int threads, std::vector<Stmt*>& out,
+                     int (*parse)(ParseContext&));
+
+#endif
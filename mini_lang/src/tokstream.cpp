@@ -0,0 +1,185 @@
+// saved token streams: the input after the lexer, in a file the parser reads in place.
+// the file is an array of 32 bit words:
+//
+//   header      magic "MLTOKENS", format version, byte order mark, token count, name
+//               count, offset of the name table, length of the source
+//   tokens      three words per token: kind, payload, offset in the source
+//   names       (offset, length) per identifier, then the characters
+//
+// the kind is the parser's token number (parser.tab.hpp), or unknownToken for a character
+// no token starts with. the payload is the value of an INTEGER, the index of an IDENTIFIER
+// in the name table (each name is stored once) and the character of an unknown token.
+// the source offset is kept for tools, the parser does not need it. the file is checked
+// once when it is loaded; replaying it is one array index per token.
+
+#include "tokstream.hpp"
+#include "ast.hpp"
+#include "parser.tab.hpp"
+#include<cstdint>
+#include<cstdio>
+#include<cstring>
+#include<fcntl.h>
+#include<string_view>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unordered_map>
+#include<unistd.h>
+
+namespace {
+
+const char magic[8] = { 'M', 'L', 'T', 'O', 'K', 'E', 'N', 'S' };
+const uint32_t formatVersion = 1;
+const uint32_t byteOrderMark = 0x01020304;
+
+// header words after the magic
+enum { versionWord, byteOrderWord, tokenCountWord, nameCountWord, namesAtWord, sourceSizeWord, headerFields };
+const uint32_t headerWords = sizeof(magic) / 4 + headerFields;
+
+enum { kindField, payloadField, offsetField, tokenWords };
+
+// the loaded stream
+const char* data = nullptr;
+const uint32_t* tokens = nullptr;
+const uint32_t* names = nullptr;
+uint32_t tokenCount = 0;
+uint32_t next = 0;
+
+bool fail(const std::string& path, const char* why){
+    fprintf(stderr, "Invalid token file %s: %s\n", path.c_str(), why);
+    return false;
+}
+
+bool knownKind(int32_t kind){
+    return kind == unknownToken || (kind >= VAR && kind <= IDENTIFIER);
+}
+
+bool check(const std::string& path, const char* file, size_t size){
+    const uint32_t* words = (const uint32_t*)file;
+    size_t count = size / 4;
+    if(size % 4 != 0 || count < headerWords || memcmp(file, magic, sizeof(magic)) != 0) return fail(path, "not a token file");
+    const uint32_t* header = words + sizeof(magic) / 4;
+    if(header[versionWord] != formatVersion || header[byteOrderWord] != byteOrderMark) return fail(path, "written by another version");
+
+    uint64_t tokenEnd = headerWords + (uint64_t)header[tokenCountWord] * tokenWords;
+    uint32_t nameCount = header[nameCountWord];
+    uint32_t namesAt = header[namesAtWord];
+    if(namesAt != tokenEnd || namesAt > count || nameCount > (count - namesAt) / 2) return fail(path, "damaged header");
+
+    const uint32_t* table = words + namesAt;
+    for(uint32_t k = 0; k < nameCount; k++){
+        if(table[2 * k] > size || table[2 * k + 1] > size - table[2 * k]) return fail(path, "damaged name table");
+    }
+    for(uint32_t k = 0; k < header[tokenCountWord]; k++){
+        const uint32_t* t = words + headerWords + k * tokenWords;
+        int32_t kind = (int32_t)t[kindField];
+        if(!knownKind(kind) || (kind == IDENTIFIER && t[payloadField] >= nameCount)) return fail(path, "damaged token");
+    }
+
+    data = file;
+    tokens = words + headerWords;
+    names = table;
+    tokenCount = header[tokenCountWord];
+    next = 0;
+    return true;
+}
+
+} // namespace
+
+bool writeTokenStream(const std::string& path, const char* text, size_t size, const std::vector<std::vector<Token>>& chunks){
+    // offsets and the source length are 32 bits
+    if(size > UINT32_MAX) return false;
+    std::vector<uint32_t> words(headerWords);
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::string_view> order;
+    uint32_t count = 0;
+    for(const std::vector<Token>& chunk : chunks){
+        for(const Token& t : chunk){
+            uint32_t payload = 0;
+            if(t.kind == INTEGER) payload = (uint32_t)t.value;
+            if(t.kind == unknownToken) payload = (unsigned char)*t.text;
+            if(t.kind == IDENTIFIER){
+                std::string_view name(t.text, t.length);
+                auto found = ids.emplace(name, (uint32_t)order.size());
+                if(found.second) order.push_back(name);
+                payload = found.first->second;
+            }
+            size_t offset = t.text - text;
+            words.push_back((uint32_t)t.kind);
+            words.push_back(payload);
+            words.push_back((uint32_t)offset);
+            count++;
+        }
+    }
+
+    // the characters follow the (offset, length) pairs, padded to whole words
+    uint32_t namesAt = (uint32_t)words.size();
+    size_t characterAt = (namesAt + 2 * order.size()) * 4;
+    std::string characters;
+    for(std::string_view n : order){
+        words.push_back((uint32_t)(characterAt + characters.size()));
+        words.push_back((uint32_t)n.size());
+        characters += n;
+    }
+    characters.resize((characters.size() + 3) / 4 * 4, '\0');
+
+    memcpy(&words[0], magic, sizeof(magic));
+    uint32_t* header = &words[sizeof(magic) / 4];
+    header[versionWord] = formatVersion;
+    header[byteOrderWord] = byteOrderMark;
+    header[tokenCountWord] = count;
+    header[nameCountWord] = (uint32_t)order.size();
+    header[namesAtWord] = namesAt;
+    header[sourceSizeWord] = (uint32_t)size;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if(!f) return false;
+    bool written = fwrite(words.data(), 4, words.size(), f) == words.size()
+                && fwrite(characters.data(), 1, characters.size(), f) == characters.size();
+    return fclose(f) == 0 && written;
+}
+
+bool loadTokenStream(const std::string& path){
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0){
+        if(fd >= 0) close(fd);
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return false;
+    }
+    if(info.st_size == 0){
+        close(fd);
+        return fail(path, "not a token file");
+    }
+
+    // stays mapped until the program ends, the parser reads it token by token
+    void* file = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file == MAP_FAILED){
+        fprintf(stderr, "Cannot map %s\n", path.c_str());
+        return false;
+    }
+    if(!check(path, (const char*)file, info.st_size)){
+        munmap(file, info.st_size);
+        return false;
+    }
+    return true;
+}
+
+int replayLex(){
+    for(; next < tokenCount; next++){
+        const uint32_t* t = tokens + next * tokenWords;
+        int kind = (int32_t)t[kindField];
+        if(kind == unknownToken){
+            printf("Unknown token: %s\n", std::string(1, (char)t[payloadField]).c_str());
+            continue;
+        }
+        if(kind == INTEGER) yylval.ival = (int32_t)t[payloadField];
+        if(kind == IDENTIFIER){
+            const uint32_t* name = names + 2 * t[payloadField];
+            yylval.sval = strndup(data + name[0], name[1]);
+        }
+        next++;
+        return kind;
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef TOKSTREAM_HPP
+#define TOKSTREAM_HPP
+
+// saved token streams (tokstream.cpp).
+// --save-tokens=FILE writes the tokens of the input, --load-tokens=FILE parses a saved
+// stream instead of reading the input: the file is mapped and its tokens are handed to the
+// parser as they are, no character is scanned again.
+
+#include "simdlex.hpp"
+#include<string>
+#include<vector>
+
+// the tokens of text[0, size), as lexInParallel() leaves them. false if the file can not be
+// written or the source is 4 GB or more
+bool writeTokenStream(const std::string& path, const char* text, size_t size, const std::vector<std::vector<Token>>& chunks);
+
+// maps the file and checks it, prints why it is rejected
+bool loadTokenStream(const std::string& path);
+
+// the parser's view of the loaded stream
+int replayLex();
+
+#endif